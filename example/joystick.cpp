@@ -2,13 +2,12 @@
 #include "motor_manager.h"
 
 #include <unistd.h>
-#include <poll.h>
+#include <fcntl.h>
 #include <iostream>
 #include <iomanip>
 
 #include "motor_app.h"
 #include "motor_thread.h"
-#include <poll.h>
 
 
 struct Joystick {
@@ -23,7 +22,9 @@ double current_gain = 500;
 class Task : public MotorThread {
  public:
   Task() : MotorThread(2000) {
-		fd_ = open("/dev/hidraw8", O_RDONLY);
+		fd_ = open("/dev/hidraw8", O_RDONLY | O_NONBLOCK);
+		// the stick only changes at about 100 Hz
+		add_task("joystick", 20, [this]{ read_joystick(); });
 	}
 	~Task() {
 		close(fd_);
@@ -34,14 +35,13 @@ class Task : public MotorThread {
         motor_manager_.set_command_mode(ModeDesired::VELOCITY);
     }
 
-	virtual void pre_update() {
-		// check for data on the pipe, timeout before a usb read is likely to finish
-		pollfd poll_fds[] = {{.fd=fd_, .events=POLLIN}};
-		timespec timeout_ts = {};
-        timeout_ts.tv_nsec=100 * 1000;
-		int retval = ppoll(poll_fds, 1, &timeout_ts, NULL);
-		if (retval) {
-            read(fd_, &joystick, sizeof(joystick));
+	void read_joystick() {
+		// keep only the newest report, commands are sent on the next cycle
+		bool updated = false;
+		while (read(fd_, &joystick, sizeof(joystick)) > 0) {
+			updated = true;
+		}
+		if (updated) {
             uint16_t ud = (joystick.l_stick[2] << 4l) | ((joystick.l_stick[1] & 0xF0) >> 4);
             uint16_t lr = joystick.l_stick[0] | ((joystick.l_stick[1] & 0xF) << 8l);
             //uint16_t ud = joystick.l_stick[1] >> 4;
@@ -1,11 +1,16 @@
 #include "motor_app.h"
 #include "motor_thread.h"
 #include <cmath>
+#include <algorithm>
 
 class Task : public MotorThread {
  public:
   Task() : MotorThread(2000) {}
  protected:
+	virtual void post_init() {
+		position_.resize(motor_manager_.motors().size());
+		velocity_.resize(motor_manager_.motors().size());
+	}
 	virtual void pre_update() {
 		motor_manager_.set_command_count(x_++);
 		motor_manager_.set_command_mode(ModeDesired::POSITION);
@@ -14,12 +19,15 @@ class Task : public MotorThread {
 		//double position = std::chrono::duration_cast<std::chrono::seconds>(data_.time_start - start_time_).count() % 2;
 		double position = 10*std::sin(std::chrono::duration_cast<std::chrono::nanoseconds>(data_.time_start - start_time_).count() / 1.0e9);
 		double velocity = 10*std::cos(std::chrono::duration_cast<std::chrono::nanoseconds>(data_.time_start - start_time_).count() / 1.0e9);
-		motor_manager_.set_command_position(std::vector<float>(motor_manager_.motors().size(), position));
-		motor_manager_.set_command_velocity(std::vector<float>(motor_manager_.motors().size(), velocity));
+		std::fill(position_.begin(), position_.end(), position);
+		std::fill(velocity_.begin(), velocity_.end(), velocity);
+		motor_manager_.set_command_position(position_);
+		motor_manager_.set_command_velocity(velocity_);
 	}
 
  private:
 	uint32_t x_ = 0;
+	std::vector<float> position_, velocity_;
 };
 
 int main (int argc, char **argv)
@@ -1,4 +1,5 @@
 #include "motor_manager.h"
+#include "command_mailbox.h"
 #include <cstdint>
 #include <chrono>
 #include <thread>
@@ -8,8 +9,8 @@ int main (int argc, char **argv) {
 
     auto m = MotorManager();
     m.get_connected_motors();
-    char data[m.serialize_command_size()];
-    auto pipe_fd = open("/tmp/deadline", O_WRONLY);
+    // the pipe example must be running to create the mailbox
+    CommandMailboxSender sender;
 
     m.set_command_mode(ModeDesired::POSITION);
 
@@ -22,10 +23,9 @@ int main (int argc, char **argv) {
         m.set_command_count(x);
         m.set_command_position(std::vector<float>(m.motors().size(), x));
         m.set_command_velocity(std::vector<float>(m.motors().size(), .1));
-        auto s = m.serialize_saved_commands(data);
-        write(pipe_fd, data, s);
+        sender.send(m.commands().data(), m.commands().size());
         printf("%d\n", x);
 
         std::this_thread::sleep_until(next_time);
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include "cycle_data.h"
+#include "motor_publisher.h"
+#include "motor_subscriber.h"
+
+// A complete set of commands sent from another process to a MotorThread
+template <size_t N>
+struct CommandSetN {
+    static const size_t max_motors = N;
+    std::chrono::steady_clock::time_point time_sent;
+    uint32_t num_motors;
+    Command commands[N];
+};
+
+typedef CommandSetN<MOTOR_THREAD_MAX_MOTORS> CommandSet;
+
+// The realtime side of a shared memory command mailbox. It creates the shared
+// memory, other processes write with a MotorPublisher<CommandSetN<N>>
+// constructed with create false, or CommandMailboxSenderN, one sender at a
+// time. Each receive() costs one atomic load when nothing new has arrived,
+// there is no syscall and no waiting. Cycles without a new command set are counted as stale and sets
+// that were replaced before the realtime thread saw them as overwritten.
+template <size_t N>
+class CommandMailboxN {
+ public:
+    CommandMailboxN(std::string shm_name = "motor_commands") : subscriber_(shm_name, true) {
+        last_sequence_ = subscriber_.sequence();
+    }
+    // the newest command set if one arrived since the last call, else nullptr
+    const CommandSetN<N> *receive() {
+        uint32_t seq = subscriber_.sequence();
+        if (seq == last_sequence_) {
+            stale_.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        command_set_ = subscriber_.read(&seq);
+        overwritten_.fetch_add(seq - last_sequence_ - 1, std::memory_order_relaxed);
+        received_.fetch_add(1, std::memory_order_relaxed);
+        last_sequence_ = seq;
+        return &command_set_;
+    }
+    // counters, safe to read from other threads
+    uint64_t received() const { return received_.load(std::memory_order_relaxed); }
+    uint64_t stale() const { return stale_.load(std::memory_order_relaxed); }
+    uint64_t overwritten() const { return overwritten_.load(std::memory_order_relaxed); }
+ private:
+    MotorSubscriber<CommandSetN<N>> subscriber_;
+    CommandSetN<N> command_set_ = {};
+    uint32_t last_sequence_;
+    std::atomic<uint64_t> received_ = {0}, stale_ = {0}, overwritten_ = {0};
+};
+
+typedef CommandMailboxN<MOTOR_THREAD_MAX_MOTORS> CommandMailbox;
+
+// The sending side, throws if the CommandMailbox does not exist yet
+template <size_t N>
+class CommandMailboxSenderN {
+ public:
+    CommandMailboxSenderN(std::string shm_name = "motor_commands") : publisher_(shm_name, false) {}
+    // send commands for num_motors motors, returns the sequence number
+    uint32_t send(const Command *commands, size_t num_motors) {
+        if (num_motors > N) {
+            throw std::runtime_error("Too many motors for CommandMailbox, maximum is " + std::to_string(N));
+        }
+        command_set_.time_sent = std::chrono::steady_clock::now();
+        command_set_.num_motors = num_motors;
+        std::copy(commands, commands + num_motors, command_set_.commands);
+        publisher_.publish(command_set_);
+        return publisher_.sequence();
+    }
+ private:
+    MotorPublisher<CommandSetN<N>> publisher_;
+    CommandSetN<N> command_set_ = {};
+};
+
+typedef CommandMailboxSenderN<MOTOR_THREAD_MAX_MOTORS> CommandMailboxSender;
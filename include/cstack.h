@@ -1,23 +1,112 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <type_traits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
-// A circular stack. If data is written by one thread and read by one other thread then data is read from the top without worrying about thread safety.
-template <class T>
+// A circular stack. One thread pushes and any number of threads, in this
+// process or in another process sharing the memory, read without locks. Every
+// slot is a seqlock, so a reader never returns a record the writer was
+// overwriting while it copied. Entries are numbered by sequence() so readers
+// can tell when they missed entries or were lapped by the writer. Readers can
+// block in wait() for the next push, the sequence number doubles as a futex
+// word that push() only wakes when a reader is waiting.
+template <class T, int N = 100>
 class CStack {
  public:
-    void push(T const &t) {
-		int future_pos = pos_.load(std::memory_order_acquire) + 1;
-		if (future_pos >= 100) {
-			future_pos = 0;
+	static_assert(std::is_trivially_copyable<T>::value, "CStack data must be trivially copyable");
+	static_assert(ATOMIC_INT_LOCK_FREE == 2, "CStack needs lock free atomics to be shared between processes");
+	static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "CStack sequence is used as a futex word");
+	enum Result { OK, LAPPED, NOT_READY };
+
+	void push(T const &t) {
+		uint32_t seq = sequence_.load(std::memory_order_relaxed) + 1;
+		Slot &slot = data_[seq % N];
+		uint32_t version = slot.version.load(std::memory_order_relaxed);
+		slot.version.store(version + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slot.seq = seq;
+		slot.data = t;
+		slot.version.store(version + 2, std::memory_order_release);
+		sequence_.store(seq, std::memory_order_release);
+		// pairs with the fence in wait(), either this sees the waiter or the
+		// waiter sees the new sequence
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (waiters_.load(std::memory_order_relaxed)) {
+			futex(FUTEX_WAKE, INT_MAX, nullptr);
+		}
+	}
+	// sequence number of the newest entry, it increments once per push
+	uint32_t sequence() const { return sequence_.load(std::memory_order_acquire); }
+	// copy entry seq, LAPPED if the writer has already overwritten it
+	Result read(uint32_t seq, T *t) const {
+		if (static_cast<int32_t>(seq - sequence()) > 0) {
+			return NOT_READY;
+		}
+		const Slot &slot = data_[seq % N];
+		uint32_t version = slot.version.load(std::memory_order_acquire);
+		if (version & 1) {
+			// being written, which only happens for a newer entry
+			return LAPPED;
+		}
+		uint32_t slot_seq = slot.seq;
+		std::memcpy(t, &slot.data, sizeof(T));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.version.load(std::memory_order_relaxed) != version || slot_seq != seq) {
+			return LAPPED;
+		}
+		return OK;
+	}
+	// copy the newest entry and optionally return its sequence number
+	void top(T *t, uint32_t *seq = nullptr) const {
+		uint32_t s;
+		do {
+			s = sequence();
+		} while (read(s, t) != OK);
+		if (seq) {
+			*seq = s;
 		}
-		data_[future_pos] = t;
-		pos_.store(future_pos, std::memory_order_release);
 	}
 	T top() const { // return a copy of the data
-		return data_[pos_.load(std::memory_order_acquire)];
+		T t;
+		top(&t);
+		return t;
+	}
+	// block until an entry newer than seq is pushed, false on timeout
+	bool wait(uint32_t seq, std::chrono::nanoseconds timeout) const {
+		auto end = std::chrono::steady_clock::now() + timeout;
+		waiters_.fetch_add(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		while (sequence() == seq) {
+			auto remaining = end - std::chrono::steady_clock::now();
+			if (remaining <= std::chrono::nanoseconds::zero()) {
+				break;
+			}
+			auto s = std::chrono::duration_cast<std::chrono::seconds>(remaining);
+			struct timespec ts = {static_cast<time_t>(s.count()), static_cast<long>((remaining - s).count())};
+			futex(FUTEX_WAIT, seq, &ts);
+		}
+		waiters_.fetch_sub(1, std::memory_order_relaxed);
+		return sequence() != seq;
 	}
  private:
-	T data_[100] = {};
-	std::atomic<int> pos_ = {0};
+	// shared, not FUTEX_PRIVATE, so waiters in other processes are woken
+	long futex(int op, uint32_t val, const struct timespec *timeout) const {
+		return syscall(SYS_futex, reinterpret_cast<const uint32_t *>(&sequence_), op, val, timeout, nullptr, 0);
+	}
+	struct Slot {
+		std::atomic<uint32_t> version;
+		uint32_t seq;
+		T data;
+	};
+	Slot data_[N] = {};
+	std::atomic<uint32_t> sequence_ = {0};
+	mutable std::atomic<uint32_t> waiters_ = {0};
 };
@@ -0,0 +1,23 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include "motor_messages.h"
+
+#ifndef MOTOR_THREAD_MAX_MOTORS
+#define MOTOR_THREAD_MAX_MOTORS 32
+#endif
+
+// One control cycle for up to N motors. It is trivially copyable so it can be
+// pushed and read without allocation and placed in shared memory.
+template <size_t N>
+struct CycleData {
+    static const size_t max_motors = N;
+    std::chrono::steady_clock::time_point time_start, last_time_start, last_time_end, aread_time, read_time, control_time, write_time;
+    uint32_t num_motors;
+    Status statuses[N];
+    Command commands[N];
+    uint8_t stale[N];       // 1 if statuses[i] is an older status because motor i was late or disconnected
+};
+
+typedef CycleData<MOTOR_THREAD_MAX_MOTORS> Data;
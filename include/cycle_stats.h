@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include "histogram.h"
+
+// A copy of CycleStats
+struct CycleStatsSnapshot {
+    HistogramSnapshot wake_latency;     // ns late waking for the cycle
+    HistogramSnapshot exec_time;        // ns from waking to finishing the cycle
+    uint64_t cycles = 0;
+    uint64_t overruns = 0;              // cycles that finished after the next cycle was due
+    uint64_t longest_overrun_streak = 0;
+};
+
+inline std::ostream &operator<<(std::ostream &os, const CycleStatsSnapshot &s) {
+    return os << "cycles " << s.cycles << ", overruns " << s.overruns
+              << ", longest overrun streak " << s.longest_overrun_streak << "\n"
+              << "wake latency ns: " << s.wake_latency << "\n"
+              << "exec time ns:    " << s.exec_time;
+}
+
+// Timing of a periodic loop. The loop thread calls record() once per cycle,
+// other threads can snapshot() at any time.
+class CycleStats {
+ public:
+    // wake_target: when the cycle was due, wake: when it started, end: when it
+    // finished, next_target: when the next cycle is due
+    void record(std::chrono::steady_clock::time_point wake_target, std::chrono::steady_clock::time_point wake,
+                std::chrono::steady_clock::time_point end, std::chrono::steady_clock::time_point next_target) {
+        auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(wake - wake_target).count();
+        wake_latency_.record(latency > 0 ? latency : 0);
+        exec_time_.record(std::chrono::duration_cast<std::chrono::nanoseconds>(end - wake).count());
+        cycles_.store(cycles_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (end > next_target) {
+            overruns_.store(overruns_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            if (++streak_ > longest_streak_.load(std::memory_order_relaxed)) {
+                longest_streak_.store(streak_, std::memory_order_relaxed);
+            }
+        } else {
+            streak_ = 0;
+        }
+    }
+    CycleStatsSnapshot snapshot() const {
+        CycleStatsSnapshot s;
+        s.wake_latency = wake_latency_.snapshot();
+        s.exec_time = exec_time_.snapshot();
+        s.cycles = cycles_.load(std::memory_order_relaxed);
+        s.overruns = overruns_.load(std::memory_order_relaxed);
+        s.longest_overrun_streak = longest_streak_.load(std::memory_order_relaxed);
+        return s;
+    }
+ private:
+    Histogram wake_latency_, exec_time_;
+    std::atomic<uint64_t> cycles_ = {0}, overruns_ = {0}, longest_streak_ = {0};
+    uint64_t streak_ = 0;
+};
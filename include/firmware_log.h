@@ -0,0 +1,82 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "cstack.h"
+
+class Motor;
+class MotorHotplug;
+
+// One firmware log message
+struct FirmwareLogEntry {
+    static const size_t kMaxLength = 64;
+    // steady_clock ns when it was drained from the motor, which can be
+    // later than when the firmware logged it
+    int64_t host_time_ns;
+    uint16_t motor;
+    uint8_t length;
+    char text[kMaxLength];
+    std::string str() const { return std::string(text, length); }
+};
+
+// Drains the firmware logs of motors into a ring per motor, from a background
+// thread per motor. The "log" text api variable gives one message per
+// request, so requests are sent in transactions that double in size, up to
+// kMaxBatch, while every reply is a message, and a burst drains at the rate
+// of the text api rather than one message per poll. Once a motor replies
+// "log end" it is polled again every poll_period.
+//
+// Any number of Readers, e.g. motor_util and MotorRecorder, read the same
+// messages concurrently without locks, each at its own position.
+//
+// Given the MotorManager's hotplug, a motor that is reconnected is drained
+// from its replacement. Without it the original Motor is polled, which fails
+// quietly once it is unplugged.
+class FirmwareLog {
+ public:
+    static const int kCapacity = 1024;
+    static const size_t kMaxBatch = 32;
+    typedef CStack<FirmwareLogEntry, kCapacity> Ring;
+
+    class Reader {
+     public:
+        // up to max new entries, in order for each motor
+        size_t read(FirmwareLogEntry *entries, size_t max);
+        // entries overwritten before this reader got to them
+        uint64_t lost() const { return lost_; }
+     private:
+        friend class FirmwareLog;
+        Reader(const FirmwareLog *log);
+        const FirmwareLog *log_;
+        std::vector<uint32_t> next_;
+        uint64_t lost_ = 0;
+    };
+
+    FirmwareLog(const std::vector<std::shared_ptr<Motor>> &motors,
+                std::chrono::milliseconds poll_period = std::chrono::milliseconds(10),
+                std::shared_ptr<MotorHotplug> hotplug = nullptr);
+    ~FirmwareLog();
+    // a reader that starts with the oldest entries still held
+    Reader reader() const { return Reader(this); }
+    size_t size() const { return motors_.size(); }
+    uint64_t entries() const;
+    // text api transactions, to compare with entries()
+    uint64_t transactions() const;
+ private:
+    void run(int motor);
+    std::vector<std::shared_ptr<Motor>> motors_;
+    // weak so that the log does not keep reconnecting after the manager stops
+    std::weak_ptr<MotorHotplug> hotplug_;
+    std::chrono::milliseconds poll_period_;
+    std::vector<std::unique_ptr<Ring>> rings_;
+    std::unique_ptr<std::atomic<uint64_t>[]> transactions_;
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool done_ = false;
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// A copy of a Histogram, safe to keep and compare. Snapshots can be
+// subtracted to get the distribution over an interval.
+struct HistogramSnapshot {
+    std::vector<uint64_t> counts;
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+    double mean() const { return count ? static_cast<double>(sum)/count : 0; }
+    // upper bound of the bucket holding fraction p of the samples, p in [0, 1]
+    uint64_t percentile(double p) const;
+    HistogramSnapshot operator-(const HistogramSnapshot &other) const;
+};
+
+// Log linear histogram of non negative integers such as nanoseconds. Each
+// power of two is split into 32 linear buckets, so a value is known to about
+// 3%. One thread records without locks or allocation, any thread can
+// snapshot() concurrently.
+class Histogram {
+ public:
+    static const int kSubBits = 5;
+    static const int kSub = 1 << kSubBits;
+    static const int kBuckets = (64 - kSubBits + 1) * kSub;
+
+    static int bucket(uint64_t v) {
+        if (v < kSub) {
+            return v;
+        }
+        int msb = 63 - __builtin_clzll(v);
+        return (msb - kSubBits + 1) * kSub + ((v >> (msb - kSubBits)) - kSub);
+    }
+    // largest value that falls in bucket i
+    static uint64_t bucket_max(int i) {
+        if (i < kSub) {
+            return i;
+        }
+        int shift = i / kSub - 1;
+        uint64_t lower = static_cast<uint64_t>(i % kSub + kSub) << shift;
+        return lower + ((1ull << shift) - 1);
+    }
+
+    // writer only
+    void record(uint64_t v) {
+        increment(counts_[bucket(v)], 1);
+        increment(count_, 1);
+        increment(sum_, v);
+        if (v > max_.load(std::memory_order_relaxed)) {
+            max_.store(v, std::memory_order_relaxed);
+        }
+    }
+    HistogramSnapshot snapshot() const {
+        HistogramSnapshot s;
+        s.counts.resize(kBuckets);
+        for (int i=0; i<kBuckets; i++) {
+            s.counts[i] = counts_[i].load(std::memory_order_relaxed);
+        }
+        s.count = count_.load(std::memory_order_relaxed);
+        s.sum = sum_.load(std::memory_order_relaxed);
+        s.max = max_.load(std::memory_order_relaxed);
+        return s;
+    }
+ private:
+    // single writer, so a plain load and store rather than a locked add
+    static void increment(std::atomic<uint64_t> &a, uint64_t n) {
+        a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    std::atomic<uint64_t> counts_[kBuckets] = {};
+    std::atomic<uint64_t> count_ = {0}, sum_ = {0}, max_ = {0};
+};
+
+inline uint64_t HistogramSnapshot::percentile(double p) const {
+    uint64_t total = 0;
+    for (auto c : counts) {
+        total += c;
+    }
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t target = p * total;
+    uint64_t n = 0;
+    for (size_t i=0; i<counts.size(); i++) {
+        n += counts[i];
+        if (n > target || n == total) {
+            uint64_t v = Histogram::bucket_max(i);
+            return v < max || max == 0 ? v : max;
+        }
+    }
+    return max;
+}
+
+inline HistogramSnapshot HistogramSnapshot::operator-(const HistogramSnapshot &other) const {
+    HistogramSnapshot s = *this;
+    for (size_t i=0; i<s.counts.size() && i<other.counts.size(); i++) {
+        s.counts[i] -= other.counts[i];
+    }
+    s.count -= other.count;
+    s.sum -= other.sum;
+    return s;
+}
+
+// count, mean, p50, p99, p99.9, p99.99 and max
+inline std::ostream &operator<<(std::ostream &os, const HistogramSnapshot &s) {
+    return os << "n " << s.count << " mean " << static_cast<uint64_t>(s.mean())
+              << " p50 " << s.percentile(.5) << " p99 " << s.percentile(.99)
+              << " p99.9 " << s.percentile(.999) << " p99.99 " << s.percentile(.9999)
+              << " max " << s.max;
+}
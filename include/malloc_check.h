@@ -0,0 +1,16 @@
+#pragma once
+
+// Debug aid for the realtime path. When built with RT_MALLOC_CHECK any malloc,
+// calloc, realloc or free made by a thread while it is inside a MallocCheck
+// scope aborts the program, so a debugger or core dump shows the caller.
+#ifdef RT_MALLOC_CHECK
+void malloc_check(bool on);
+#else
+inline void malloc_check(bool on) {}
+#endif
+
+class MallocCheck {
+ public:
+    MallocCheck() { malloc_check(true); }
+    ~MallocCheck() { malloc_check(false); }
+};
@@ -13,18 +13,66 @@
 #include <linux/usbdevice_fs.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <poll.h>
 #include <errno.h>
 #include <stdexcept>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
 #include "motor_messages.h"
+#include "motor_parameters.h"
 
 class TextFile {
  public:
+    // longest request or reply, a USB text transfer is one 64 byte packet
+    static const size_t kMaxLength = 64;
     virtual ~TextFile() {}
     virtual void flush() {}
     virtual ssize_t read(char *data, unsigned int length) { return 0; };
     virtual ssize_t write(const char *data, unsigned int length) { return 0; };
     virtual ssize_t writeread(const char *data_out, unsigned int length_out, char *data_in, unsigned int length_in) { return 0; }
+    // Run requests as one transaction, replies[i] answers requests[i]. The
+    // firmware takes one request at a time, so this is a writeread per
+    // request, but other callers, in this process or another, cannot come in
+    // between.
+    virtual void transact(const std::vector<std::string> &requests, std::vector<std::string> *replies) {
+        for (auto &request : requests) {
+            replies->push_back(writeread_string(request));
+        }
+    }
+ protected:
+    std::string writeread_string(const std::string &request) {
+        char c[64];
+        auto nbytes = writeread(request.c_str(), request.size(), c, 64);
+        return std::string(c, nbytes > 0 ? nbytes : 0);
+    }
+    // excludes other threads, see TextFileLock
+    std::mutex mutex_;
+};
+
+// Lock on a text file for the length of a transaction. lockf excludes other
+// processes but belongs to the whole process, so the file's mutex excludes
+// other threads. lockf covers from the current offset, so the file is
+// rewound first.
+class TextFileLock {
+ public:
+    TextFileLock(int fd, std::mutex &mutex) : lock_(mutex), fd_(fd) {
+        ::lseek(fd_, 0, SEEK_SET);
+        lockf(fd_, F_LOCK, 0);
+    }
+    ~TextFileLock() {
+        ::lseek(fd_, 0, SEEK_SET);
+        lockf(fd_, F_ULOCK, 0);
+    }
+ private:
+    std::lock_guard<std::mutex> lock_;
+    int fd_;
 };
 
 class SysfsFile : public TextFile {
@@ -48,16 +96,25 @@ class SysfsFile : public TextFile {
     }
     // locked/blocked to one caller so that a read is a response to write
     ssize_t writeread(const char *data_out, unsigned int length_out, char *data_in, unsigned int length_in) {
+        TextFileLock lock(fd_, mutex_);
+        return writeread_unlocked(data_out, length_out, data_in, length_in);
+    }
+    // one lock for all of the requests
+    void transact(const std::vector<std::string> &requests, std::vector<std::string> *replies) {
+        TextFileLock lock(fd_, mutex_);
+        char c[64];
+        for (auto &request : requests) {
+            auto nbytes = writeread_unlocked(request.c_str(), request.size(), c, 64);
+            replies->push_back(std::string(c, nbytes > 0 ? nbytes : 0));
+        }
+    }
+ private:
+    ssize_t writeread_unlocked(const char *data_out, unsigned int length_out, char *data_in, unsigned int length_in) {
         ::lseek(fd_, 0, SEEK_SET);
-        lockf(fd_, F_LOCK, 0);
         write(data_out, length_out);
         ::lseek(fd_, 0, SEEK_SET);
-        auto retval = read(data_in, length_in);
-        ::lseek(fd_, 0, SEEK_SET);
-        lockf(fd_, F_ULOCK, 0);
-        return retval;
+        return read(data_in, length_in);
     }
- private:
     ssize_t read(char *data, unsigned int length) {
         // sysfs file needs to closed and opened or lseek to beginning.
         ::lseek(fd_, 0, SEEK_SET);
@@ -92,16 +149,25 @@ class USBFile : public TextFile {
     }
     // locked/blocked to one caller so that a read is a response to write
     ssize_t writeread(const char *data_out, unsigned int length_out, char *data_in, unsigned int length_in) {
+        TextFileLock lock(fd_, mutex_);
+        return writeread_unlocked(data_out, length_out, data_in, length_in);
+    }
+    // one lock for all of the requests
+    void transact(const std::vector<std::string> &requests, std::vector<std::string> *replies) {
+        TextFileLock lock(fd_, mutex_);
+        char c[64];
+        for (auto &request : requests) {
+            auto nbytes = writeread_unlocked(request.c_str(), request.size(), c, 64);
+            replies->push_back(std::string(c, nbytes > 0 ? nbytes : 0));
+        }
+    }
+ private:
+    ssize_t writeread_unlocked(const char *data_out, unsigned int length_out, char *data_in, unsigned int length_in) {
         ::lseek(fd_, 0, SEEK_SET);
-        lockf(fd_, F_LOCK, 0);
         write(data_out, length_out);
         ::lseek(fd_, 0, SEEK_SET);
-        auto retval = read(data_in, length_in);
-        ::lseek(fd_, 0, SEEK_SET);
-        lockf(fd_, F_ULOCK, 0);
-        return retval;
+        return read(data_in, length_in);
     }
- private:
     ssize_t read(char *data, unsigned int length) { 
         struct usbdevfs_bulktransfer transfer = {
             .ep = ep_num_ | USB_DIR_IN,
@@ -121,7 +187,10 @@ class USBFile : public TextFile {
         return retval;
     }
     ssize_t write(const char *data, unsigned int length) { 
-        char buf[64];
+        char buf[kMaxLength];
+        if (length > sizeof(buf)) {
+            throw std::runtime_error("USB write too long, " + std::to_string(length) + " bytes, maximum is " + std::to_string(sizeof(buf)));
+        }
         std::memcpy(buf, data, length);
         struct usbdevfs_bulktransfer transfer = {
             .ep = ep_num_ | USB_DIR_OUT,
@@ -173,6 +242,80 @@ inline double& operator<<(double& d, TextAPIItem const& item) {
     d = std::stod(item.get());
     return d;
 }
+
+// Reply to one request of a TextAPIBatch
+struct TextAPIValue {
+    std::string name;
+    std::string str;
+    // the whole reply is a number, surrounding whitespace aside
+    bool is_number() const {
+        double d;
+        return parse(&d);
+    }
+    double as_double() const {
+        double d;
+        if (!parse(&d)) {
+            throw std::runtime_error("Text api " + name + " is not a number: " + str);
+        }
+        return d;
+    }
+    int64_t as_int() const { return static_cast<int64_t>(as_double()); }
+ private:
+    bool parse(double *d) const {
+        const char *begin = str.c_str();
+        char *end;
+        errno = 0;
+        *d = std::strtod(begin, &end);
+        while (*end && std::isspace(static_cast<unsigned char>(*end))) {
+            end++;
+        }
+        return end != begin && *end == 0 && errno == 0;
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& os, TextAPIValue const& value) {
+    return os << value.name << ": " << value.str;
+}
+
+// Several text api gets and sets in one transaction, e.g.
+// auto values = TextAPIBatch(motor.motor_text()).get("kp").get("ki").set("kd", 0.1).run();
+// values[i] is then the reply to the i'th get or set.
+class TextAPIBatch {
+ public:
+    TextAPIBatch(TextFile *motor_txt) : motor_txt_(motor_txt) {}
+    TextAPIBatch &get(const std::string &name) {
+        names_.push_back(name);
+        requests_.push_back(name);
+        return *this;
+    }
+    TextAPIBatch &set(const std::string &name, const std::string &value) {
+        names_.push_back(name);
+        requests_.push_back(name + "=" + value);
+        return *this;
+    }
+    TextAPIBatch &set(const std::string &name, double value) {
+        char c[32];
+        std::snprintf(c, sizeof(c), "%.9g", value);
+        return set(name, std::string(c));
+    }
+    size_t size() const { return requests_.size(); }
+    std::vector<TextAPIValue> run() const {
+        std::vector<std::string> replies;
+        replies.reserve(requests_.size());
+        motor_txt_->transact(requests_, &replies);
+        std::vector<TextAPIValue> values(requests_.size());
+        for (size_t i=0; i<values.size(); i++) {
+            values[i].name = names_[i];
+            if (i < replies.size()) {
+                values[i].str = replies[i];
+            }
+        }
+        return values;
+    }
+ private:
+    TextFile *motor_txt_;
+    std::vector<std::string> names_, requests_;
+};
 class Motor {
  public:
     Motor() {}
@@ -180,17 +323,29 @@ class Motor {
     virtual ~Motor();
     virtual ssize_t read() { return ::read(fd_, &status_, sizeof(status_)); };
     virtual ssize_t write() { return ::write(fd_, &command_, sizeof(command_)); };
-    ssize_t aread() { int fcntl_error = fcntl(fd_, F_SETFL, fd_flags_ | O_NONBLOCK);
+    // Transfers return -1 with errno set on failure rather than throwing, so
+    // that errors cost nothing extra in a realtime loop.
+    // start a read without waiting for it to complete, read() then completes it
+    virtual int submit_read() { return 0; }
+    // 0 once the read is started, a byte count if data was already there
+    virtual ssize_t aread() { int fcntl_error = fcntl(fd_, F_SETFL, fd_flags_ | O_NONBLOCK);
 			ssize_t read_error = read(); 
             fcntl_error = fcntl(fd_, F_SETFL, fd_flags_);
-            if (read_error != -1) {
-                std::cout << "Nonzero aread" << std::endl;
-            } else {
-                if (errno != EAGAIN) {
-                    std::cout << "Aread error " << errno << std::endl;
-                }
+            if (read_error == -1 && errno == EAGAIN) {
+                return 0;
             }
             return read_error; }
+    // Complete a read or write, giving up at deadline with -1 and errno
+    // ETIMEDOUT if the motor has not answered. Kernel driver writes are not
+    // bounded.
+    virtual ssize_t timed_read(std::chrono::steady_clock::time_point deadline) {
+        if (!wait_fd(POLLIN, deadline)) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        return read();
+    }
+    virtual ssize_t timed_write(std::chrono::steady_clock::time_point deadline) { return write(); }
     std::string name() const { return name_; }
     std::string serial_number() const { return serial_number_; }
     std::string base_path() const {return base_path_; }
@@ -204,12 +359,40 @@ class Motor {
     }
     // note will probably not be the final interface
     TextAPIItem operator[](const std::string s) { TextAPIItem t(motor_txt_, s); return t; };
+    TextAPIBatch text_batch() { return TextAPIBatch(motor_txt_); }
+    // values of names in one transaction
+    std::vector<TextAPIValue> get(const std::vector<std::string> &names) {
+        TextAPIBatch batch(motor_txt_);
+        for (auto &name : names) {
+            batch.get(name);
+        }
+        return batch.run();
+    }
     int fd() const { return fd_; }
     const Status *const status() const { return &status_; }
     Command *const command() { return &command_; }
     TextFile* motor_text() { return motor_txt_; }
+    // constants such as mcpr, read once and cached, see MotorParameters
+    MotorParameters &parameters() { return parameters_; }
  protected:
+    friend class MotorIOUring;
     int open() { fd_ = ::open(dev_path_.c_str(), O_RDWR); fd_flags_ = fcntl(fd_, F_GETFL); return fd_; }
+    // false if fd_ is not ready for events by deadline
+    bool wait_fd(short events, std::chrono::steady_clock::time_point deadline) {
+        auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now()).count();
+        struct timespec ts = {};
+        if (remaining > 0) {
+            ts.tv_sec = remaining / 1000000000;
+            ts.tv_nsec = remaining % 1000000000;
+        }
+        struct pollfd pfd = { .fd = fd_, .events = events };
+        int retval;
+        do {
+            retval = ::ppoll(&pfd, 1, &ts, NULL);
+        } while (retval < 0 && errno == EINTR);
+        // on an error let the read or write report it
+        return retval != 0;
+    }
     int close() { return ::close(fd_); }
     int fd_ = 0;
     int fd_flags_;
@@ -217,6 +400,7 @@ class Motor {
     Status status_ = {};
     Command command_ = {};
     TextFile *motor_txt_;
+    MotorParameters parameters_{*this};
 };
 
 class SimulatedMotor : public Motor {
@@ -235,6 +419,8 @@ class SimulatedMotor : public Motor {
        }
        return sizeof(command_); 
    };
+   virtual ssize_t timed_read(std::chrono::steady_clock::time_point deadline) { return read(); }
+   virtual ssize_t timed_write(std::chrono::steady_clock::time_point deadline) { return write(); }
    void set_gear_ratio(double gear_ratio) { gear_ratio_ = gear_ratio; }
  private:
     double gear_ratio_ = 1;
@@ -283,38 +469,94 @@ class UserSpaceMotor : public Motor {
         open();
         motor_txt_ = new USBFile(fd_, 1);
     }
-    virtual ~UserSpaceMotor() { close(); }
-    virtual ssize_t read() { 
-        char data[64];
-        struct usbdevfs_bulktransfer transfer = {
-            .ep = ep_num_ | USB_DIR_IN,
-            .len = sizeof(status_),
-            .timeout = 100,
-            .data = &status_
-        };
-
-        int retval = ::ioctl(fd_, USBDEVFS_BULK, &transfer);
+    virtual ~UserSpaceMotor() { close(); delete read_urb_; delete write_urb_; }
+    // Asynchronous transfers through usbdevfs urbs. The in urb is submitted by
+    // submit_read() and reaped by read(), so all motors can have a read in
+    // flight at once. The out urb is submitted by write() and reaped when done
+    // or at the next write(). A urb that misses a timed_read() or
+    // timed_write() deadline is left in flight rather than discarded, since a
+    // discard blocks until the host controller gives the urb back.
+    virtual int submit_read() {
+        if (read_pending_ && read_late_) {
+            // the late read may have finished since, its status is old
+            if (!reap(read_urb_, std::chrono::steady_clock::time_point(), false) && errno != ETIMEDOUT) {
+                return -1;
+            }
+        }
+        if (read_pending_) {
+            return 0;
+        }
+        read_late_ = false;
+        std::memset(read_urb_, 0, sizeof(*read_urb_));
+        read_urb_->type = USBDEVFS_URB_TYPE_BULK;
+        read_urb_->endpoint = ep_num_ | USB_DIR_IN;
+        read_urb_->buffer = &status_in_;
+        read_urb_->buffer_length = sizeof(status_in_);
+        int retval = ::ioctl(fd_, USBDEVFS_SUBMITURB, read_urb_);
         if (retval < 0) {
-            throw std::runtime_error("Motor read error " + std::to_string(errno) + ": " + strerror(errno));
+            return -1;
         }
-        return retval;
+        read_pending_ = true;
+        return 0;
+    }
+    virtual ssize_t aread() { return submit_read(); }
+    virtual ssize_t read() { 
+        return timed_read(std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms_));
+    }
+    virtual ssize_t timed_read(std::chrono::steady_clock::time_point deadline) {
+        if (submit_read() < 0) {
+            return -1;
+        }
+        if (!reap(read_urb_, deadline, false)) {
+            // left in flight, the next submit_read() reaps it without waiting
+            read_late_ = errno == ETIMEDOUT;
+            return -1;
+        }
+        read_late_ = false;
+        return finish_read();
     }
     virtual ssize_t write() { 
-        char data[64];
-        struct usbdevfs_bulktransfer transfer = {
-            .ep = ep_num_ | USB_DIR_OUT,
-            .len = sizeof(command_),
-            .timeout = 100,
-            .data = &command_
-        };
-
-        int retval = ::ioctl(fd_, USBDEVFS_BULK, &transfer);
-        if (retval < 0) {
-            throw std::runtime_error("Motor write error " + std::to_string(errno) + ": " + strerror(errno));
+        // command_out_ belongs to the previous urb until it is reaped
+        if (!reap(write_urb_, std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms_))) {
+            return -1;
         }
-        return retval;
+        return submit_write();
+    }
+    virtual ssize_t timed_write(std::chrono::steady_clock::time_point deadline) {
+        // a late write is left in flight and this command skipped
+        if (!reap(write_urb_, deadline, false)) {
+            return -1;
+        }
+        return submit_write();
     }
  private:
+    ssize_t finish_read() {
+        if (read_urb_->status < 0) {
+            errno = -read_urb_->status;
+            return -1;
+        }
+        std::memcpy(&status_, &status_in_, read_urb_->actual_length);
+        return read_urb_->actual_length;
+    }
+    ssize_t submit_write() {
+        if (write_urb_->status < 0) {
+            errno = -write_urb_->status;
+            write_urb_->status = 0;
+            return -1;
+        }
+        command_out_ = command_;
+        std::memset(write_urb_, 0, sizeof(*write_urb_));
+        write_urb_->type = USBDEVFS_URB_TYPE_BULK;
+        write_urb_->endpoint = ep_num_ | USB_DIR_OUT;
+        write_urb_->buffer = &command_out_;
+        write_urb_->buffer_length = sizeof(command_out_);
+        int retval = ::ioctl(fd_, USBDEVFS_SUBMITURB, write_urb_);
+        if (retval < 0) {
+            return -1;
+        }
+        write_pending_ = true;
+        return sizeof(command_out_);
+    }
     int open() {
         int retval = Motor::open();
         struct usbdevfs_disconnect_claim claim = { 0, USBDEVFS_DISCONNECT_CLAIM_IF_DRIVER, "usb_rt" };
@@ -324,21 +566,73 @@ class UserSpaceMotor : public Motor {
         }
         return retval;
     }
+    // reap completed urbs until urb is done, false with errno ETIMEDOUT if it
+    // is not done by deadline, when it is also discarded if discard_late, or
+    // false with errno of a failed reap
+    bool reap(struct usbdevfs_urb *urb, std::chrono::steady_clock::time_point deadline, bool discard_late = true) {
+        while (pending(urb)) {
+            struct usbdevfs_urb *reaped;
+            int retval = ::ioctl(fd_, USBDEVFS_REAPURBNDELAY, &reaped);
+            if (retval == 0) {
+                pending(reaped) = false;
+                continue;
+            }
+            if (errno != EAGAIN) {
+                return false;
+            }
+            // usbdevfs signals POLLOUT when there is a completed urb to reap
+            if (!wait_fd(POLLOUT, deadline)) {
+                if (discard_late) {
+                    discard(urb);
+                }
+                errno = ETIMEDOUT;
+                return false;
+            }
+        }
+        return true;
+    }
+    void discard(struct usbdevfs_urb *urb) {
+        if (!pending(urb)) {
+            return;
+        }
+        ::ioctl(fd_, USBDEVFS_DISCARDURB, urb);
+        while (pending(urb)) {
+            struct usbdevfs_urb *reaped;
+            if (::ioctl(fd_, USBDEVFS_REAPURB, &reaped) < 0) {
+                // device is gone, nothing left to reap
+                read_pending_ = write_pending_ = false;
+                break;
+            }
+            pending(reaped) = false;
+        }
+    }
+    bool &pending(struct usbdevfs_urb *urb) { return urb == read_urb_ ? read_pending_ : write_pending_; }
+    // called from the destructor, so errors are returned, they are expected
+    // when the device has been unplugged
     int close() {
+        discard(read_urb_);
+        discard(write_urb_);
         int interface_num = 0;
         int ioval = ::ioctl(fd_, USBDEVFS_RELEASEINTERFACE, &interface_num); 
         if (ioval < 0) {
-            throw std::runtime_error("Motor release interface error " + std::to_string(errno) + ": " + strerror(errno));
+            return -1;
         }
         struct usbdevfs_ioctl connect = { .ifno = 0, .ioctl_code=USBDEVFS_CONNECT };
         ioval = ::ioctl(fd_, USBDEVFS_IOCTL, &connect); // allow kernel driver to reconnect
         if (ioval < 0) {
-            throw std::runtime_error("Motor close error " + std::to_string(errno) + ": " + strerror(errno));
+            return -1;
         }
         // fd_ closed by base
         return 0;
     }
     unsigned int ep_num_;
+    int timeout_ms_ = 100;
+    // allocated separately, usbdevfs_urb ends in a flexible array
+    struct usbdevfs_urb *read_urb_ = new usbdevfs_urb(), *write_urb_ = new usbdevfs_urb();
+    bool read_pending_ = false, write_pending_ = false;
+    bool read_late_ = false;    // read_urb_ is pending past the deadline of an earlier read
+    Status status_in_ = {};
+    Command command_out_ = {};
 };
 
 #endif
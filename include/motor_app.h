@@ -1,6 +1,7 @@
 #pragma once
 
-class MotorThread;
+#include <string>
+#include "motor_thread.h"
 
 class MotorApp {
  public:
@@ -8,4 +9,6 @@ class MotorApp {
     int run();
  private:
     MotorThread *motor_thread_;
+    std::string log_filename_;
+    std::string firmware_log_filename_;
 };
\ No newline at end of file
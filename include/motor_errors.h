@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// A copy of MotorErrors
+struct MotorErrorCounts {
+    uint64_t late_reads = 0;        // not answered within the io budget
+    uint64_t late_writes = 0;
+    uint64_t short_reads = 0;       // fewer bytes than a Status
+    uint64_t timeouts = 0;          // ETIMEDOUT from the transport itself
+    uint64_t disconnects = 0;       // ENODEV, ESHUTDOWN, ENOENT
+    uint64_t protocol_errors = 0;   // EPROTO, EPIPE, EOVERFLOW, EILSEQ, ECOMM
+    uint64_t other_errors = 0;
+    int last_errno = 0;
+    uint64_t total() const {
+        return late_reads + late_writes + short_reads + timeouts + disconnects + protocol_errors + other_errors;
+    }
+    MotorErrorCounts operator-(const MotorErrorCounts &other) const {
+        MotorErrorCounts c = *this;
+        c.late_reads -= other.late_reads;
+        c.late_writes -= other.late_writes;
+        c.short_reads -= other.short_reads;
+        c.timeouts -= other.timeouts;
+        c.disconnects -= other.disconnects;
+        c.protocol_errors -= other.protocol_errors;
+        c.other_errors -= other.other_errors;
+        return c;
+    }
+};
+
+// nonzero counts only, e.g. "2 timeouts, 1 protocol errors (last errno 71: Protocol error)"
+inline std::ostream &operator<<(std::ostream &os, const MotorErrorCounts &c) {
+    const char *separator = "";
+    auto field = [&](uint64_t n, const char *name) {
+        if (n) {
+            os << separator << n << " " << name;
+            separator = ", ";
+        }
+    };
+    field(c.late_reads, "late reads");
+    field(c.late_writes, "late writes");
+    field(c.short_reads, "short reads");
+    field(c.timeouts, "timeouts");
+    field(c.disconnects, "disconnects");
+    field(c.protocol_errors, "protocol errors");
+    field(c.other_errors, "other errors");
+    if (c.last_errno) {
+        os << " (last errno " << c.last_errno << ": " << std::strerror(c.last_errno) << ")";
+    }
+    return os;
+}
+
+// I/O error counters of one motor. The realtime thread records without
+// locks, allocation or formatting, any thread can read counts().
+class MotorErrors {
+ public:
+    // a failed transfer, with its errno
+    void error(int err) {
+        switch (err) {
+            case ETIMEDOUT:
+                increment(timeouts_);
+                break;
+            case ENODEV: case ESHUTDOWN: case ENOENT:
+                increment(disconnects_);
+                break;
+            case EPROTO: case EPIPE: case EOVERFLOW: case EILSEQ: case ECOMM:
+                increment(protocol_errors_);
+                break;
+            default:
+                increment(other_errors_);
+                break;
+        }
+        last_errno_.store(err, std::memory_order_relaxed);
+    }
+    void late_read() { increment(late_reads_); }
+    void late_write() { increment(late_writes_); }
+    void short_read() { increment(short_reads_); }
+    MotorErrorCounts counts() const {
+        MotorErrorCounts c;
+        c.late_reads = late_reads_.load(std::memory_order_relaxed);
+        c.late_writes = late_writes_.load(std::memory_order_relaxed);
+        c.short_reads = short_reads_.load(std::memory_order_relaxed);
+        c.timeouts = timeouts_.load(std::memory_order_relaxed);
+        c.disconnects = disconnects_.load(std::memory_order_relaxed);
+        c.protocol_errors = protocol_errors_.load(std::memory_order_relaxed);
+        c.other_errors = other_errors_.load(std::memory_order_relaxed);
+        c.last_errno = last_errno_.load(std::memory_order_relaxed);
+        return c;
+    }
+ private:
+    // single writer, so a plain load and store rather than a locked add
+    static void increment(std::atomic<uint64_t> &a) {
+        a.store(a.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    std::atomic<uint64_t> late_reads_ = {0}, late_writes_ = {0}, short_reads_ = {0}, timeouts_ = {0},
+        disconnects_ = {0}, protocol_errors_ = {0}, other_errors_ = {0};
+    std::atomic<int> last_errno_ = {0};
+};
+
+// Formats the errors that happened since the last report, away from the
+// realtime thread. counts are MotorManager::errors(i) for each motor.
+class MotorErrorReporter {
+ public:
+    MotorErrorReporter(std::vector<std::string> names) : names_(names), last_(names.size()) {}
+    // one line per motor with new errors, empty if there are none
+    std::string report(const std::vector<MotorErrorCounts> &counts) {
+        std::ostringstream ss;
+        for (size_t i=0; i<counts.size() && i<names_.size(); i++) {
+            MotorErrorCounts diff = counts[i] - last_[i];
+            if (diff.total()) {
+                ss << names_[i] << ": " << diff << "\n";
+            }
+            last_[i] = counts[i];
+        }
+        return ss.str();
+    }
+ private:
+    std::vector<std::string> names_;
+    std::vector<MotorErrorCounts> last_;
+};
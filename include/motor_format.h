@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "motor_messages.h"
+
+// Formats Status and Command rows into a reusable char buffer. The columns and
+// the reserved_uint32 option match the std::vector<Status> and
+// std::vector<Command> stream operators, but numbers are converted directly
+// rather than through iostreams and nothing allocates once the buffer has
+// grown to the row size. Floats print as an ostream with default flags would,
+// with precision() significant digits, or with precision() decimals once
+// set_fixed() is on.
+class MotorFormatter {
+ public:
+    MotorFormatter(size_t capacity = 4096) { buffer_.resize(capacity); }
+    void clear() { size_ = 0; }
+    const char *data() const { return buffer_.data(); }
+    size_t size() const { return size_; }
+    std::string str() const { return std::string(data(), size()); }
+
+    // significant digits, as std::setprecision(), or digits after the decimal
+    // point in fixed mode
+    void set_precision(int precision) { precision_ = precision; }
+    int precision() const { return precision_; }
+    // fixed point floats, as std::fixed
+    void set_fixed(bool fixed = true) { fixed_ = fixed; }
+    // print Status reserved[1] and reserved[2] as uint32, as reserved_uint32
+    void set_reserved_uint32(bool reserved_uint32 = true) { reserved_uint32_ = reserved_uint32; }
+    // pad columns to the widths the Status stream operator uses
+    void set_aligned(bool aligned = true) { aligned_ = aligned; }
+
+    MotorFormatter &append(uint32_t u, int width = 0);
+    MotorFormatter &append(int32_t i, int width = 0);
+    MotorFormatter &append(uint64_t u, int width = 0);
+    MotorFormatter &append(int64_t i, int width = 0);
+    MotorFormatter &append(double d, int width = 0);
+    MotorFormatter &append(const char *s);
+    MotorFormatter &append(char c);
+    // each value is followed by ", " as with the stream operators
+    MotorFormatter &append(const Command *commands, size_t num_motors);
+    MotorFormatter &append(const Status *statuses, size_t num_motors);
+    MotorFormatter &append(const std::vector<Command> &commands) { return append(commands.data(), commands.size()); }
+    MotorFormatter &append(const std::vector<Status> &statuses) { return append(statuses.data(), statuses.size()); }
+ private:
+    char *reserve(size_t n);
+    int format_fixed(double d, int precision, char *tmp, size_t size);
+    int format_general(double d, char *tmp, size_t size);
+    MotorFormatter &separator() { return append(", "); }
+    std::vector<char> buffer_;
+    size_t size_ = 0;
+    int precision_ = 6;
+    bool fixed_ = false;
+    bool reserved_uint32_ = false;
+    bool aligned_ = false;
+};
@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Motor;
+class MotorIOUring;
+struct udev;
+struct udev_device;
+struct udev_monitor;
+
+// Reconnects motors from a background thread. It watches udev for motor
+// devices coming and going and keeps an index of the ones present by usb
+// path. When the realtime thread reports a motor as disconnected, the
+// replacement Motor, and a new MotorIOUring if one is in use, are opened on
+// the background thread and handed over with take(). Motors and rings that
+// are replaced are destroyed on the background thread as well, so the
+// realtime side never blocks, allocates or frees.
+class MotorHotplug {
+ public:
+    enum State { CONNECTED, DISCONNECTED };
+    MotorHotplug(const std::vector<std::shared_ptr<Motor>> &motors, bool user_space_driver, bool io_uring);
+    ~MotorHotplug();
+
+    // realtime side
+    bool connected(int i) const { return state_[i].load(std::memory_order_acquire) == CONNECTED; }
+    // motor i failed, stop using it until it is replaced
+    void disconnected(int i);
+    // swap in a replacement if one is ready, O(1). Only call when io_uring
+    // has nothing in flight, as the ring is replaced along with the motor.
+    bool take(std::vector<std::shared_ptr<Motor>> &motors, std::shared_ptr<MotorIOUring> &io_uring);
+
+    // safe from any thread
+    uint64_t reconnects() const { return reconnects_.load(std::memory_order_relaxed); }
+    // the newest motor at i, a replacement as soon as it is opened, before
+    // the realtime side takes it
+    std::shared_ptr<Motor> motor(int i) const;
+ private:
+    enum SwapState { EMPTY, READY, TAKEN };
+    void run();
+    void notify();
+    void scan();
+    void receive_events();
+    void check(int i);
+    std::string base_path(udev_device *dev) const;
+    bool is_motor(udev_device *dev) const;
+
+    bool user_space_driver_, io_uring_;
+    // background thread's copy of the motors the realtime thread is using,
+    // written on the background thread under motors_mutex_
+    std::vector<std::shared_ptr<Motor>> motors_;
+    mutable std::mutex motors_mutex_;
+    std::vector<std::string> base_paths_;
+    std::unique_ptr<std::atomic<int>[]> state_;
+    std::vector<bool> seen_disconnected_, removed_;
+    std::vector<std::chrono::steady_clock::time_point> next_attempt_;
+    // devnode to usb path of the motors present
+    std::map<std::string, std::string> index_;
+
+    // one replacement in flight at a time
+    std::atomic<int> swap_state_ = {EMPTY};
+    int swap_index_ = 0;
+    std::shared_ptr<Motor> swap_motor_;
+    std::shared_ptr<MotorIOUring> swap_io_uring_;
+
+    std::atomic<uint64_t> reconnects_ = {0};
+    std::atomic<bool> done_ = {false};
+    udev *udev_ = nullptr;
+    udev_monitor *monitor_ = nullptr;
+    int event_fd_ = -1;
+    std::thread thread_;
+};
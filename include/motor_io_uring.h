@@ -0,0 +1,63 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+#include <sys/types.h>
+
+class Motor;
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+// Batched reads and writes for kernel driver motors through one io_uring.
+// Motor fds are registered and each motor's status and command are
+// registered as fixed buffers, so a cycle is one submission for the reads of
+// all motors and one for the writes. Motors that are not kernel driver
+// motors are left for the caller to read and write directly.
+class MotorIOUring {
+ public:
+    MotorIOUring(const std::vector<std::shared_ptr<Motor>> &motors);
+    ~MotorIOUring();
+    bool handles(int i) const { return handled_[i]; }
+    // queue a read on every motor that does not have one in flight, without
+    // waiting
+    void submit_read();
+    // complete reads, submitting them first if not already in flight, giving
+    // up at deadline. result(i) is then the byte count or -errno for motor i,
+    // unless read_pending(i) because it is late.
+    void read(std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max());
+    // wait for the previous writes so that commands can be changed, giving up
+    // at deadline. Commands of motors that are still write_pending(i) must
+    // not be changed.
+    void finish_write(std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max());
+    // queue a write on every motor without one in flight, without waiting
+    void write();
+    ssize_t result(int i) const { return read_result_[i]; }
+    // byte count or -errno of motor i's last completed write
+    ssize_t write_result(int i) const { return write_result_[i]; }
+    bool read_pending(int i) const { return read_pending_[i]; }
+    bool write_pending(int i) const { return write_pending_[i]; }
+    // nothing in flight
+    bool idle() const { return !reads_in_flight_ && !writes_in_flight_; }
+ private:
+    void queue(uint8_t opcode, int i);
+    // -1 with errno on error, rather than throwing, as it is on the realtime path
+    int enter(unsigned int min_complete);
+    void reap();
+    // reap until nothing of count is in flight or deadline
+    void wait(const int &count, std::chrono::steady_clock::time_point deadline);
+    void close();
+    std::vector<std::shared_ptr<Motor>> motors_;
+    std::vector<bool> handled_;
+    std::vector<ssize_t> read_result_, write_result_;
+    std::vector<bool> read_pending_, write_pending_;
+    int ring_fd_ = -1;
+    void *sq_ptr_ = nullptr, *cq_ptr_ = nullptr;
+    size_t sq_size_ = 0, cq_size_ = 0, sqes_size_ = 0;
+    unsigned int *sq_head_, *sq_tail_, *sq_mask_, *sq_array_;
+    unsigned int *cq_head_, *cq_tail_, *cq_mask_;
+    io_uring_sqe *sqes_ = nullptr;
+    io_uring_cqe *cqes_;
+    unsigned int to_submit_ = 0;
+    int reads_in_flight_ = 0, writes_in_flight_ = 0;
+};
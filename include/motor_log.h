@@ -0,0 +1,121 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "motor_messages.h"
+
+// Binary columnar log of Status and Command records.
+//
+// The file is a header followed by segments. The header holds the motor names
+// and a description of every field. Each segment holds up to segment_records
+// records stored as columns: time first, then for every field the values of
+// motor 0, motor 1, ... Counters and encoder values are delta and zigzag
+// varint encoded, everything else is stored raw. Segments start on page
+// boundaries and deltas restart in each one. Each segment header has its size
+// and time range, so the segment headers are a sparse time index for random
+// access.
+namespace motor_log {
+
+const char kMagic[8] = {'M', 'O', 'T', 'O', 'R', 'L', 'O', 'G'};
+const uint32_t kVersion = 1;
+const uint32_t kSegmentMagic = 0x4d474553; // "SEGM"
+
+enum Type : uint8_t { UINT8, UINT32, INT32, INT64, FLOAT };
+enum Encoding : uint8_t { RAW, DELTA_VARINT };
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;       // bytes before the first segment
+    uint32_t num_motors;
+    uint32_t num_fields;        // not counting time
+    uint32_t segment_records;   // maximum records per segment
+    uint32_t max_segment_size;  // worst case bytes per segment
+    uint32_t page_size;         // segment alignment
+    uint32_t reserved;
+    uint64_t num_segments;
+    uint64_t num_records;
+    // followed by char motor_names[num_motors][32] and FieldInfo[num_fields]
+};
+
+struct FieldInfo {
+    char name[32];
+    uint8_t type;
+    uint8_t encoding;
+    uint8_t size;
+    uint8_t is_command;
+    uint32_t offset;            // into Status or Command
+};
+
+struct SegmentHeader {
+    uint32_t magic;
+    uint32_t size;              // bytes used, the next segment is page aligned after
+    uint32_t num_records;
+    uint32_t reserved;
+    uint64_t first_record;
+    int64_t first_time_ns;
+    int64_t last_time_ns;
+    // followed by BlockInfo[1 + num_fields*num_motors], time first
+};
+
+struct BlockInfo {
+    uint32_t offset;            // from the start of the segment
+    uint32_t size;
+};
+
+// the fields recorded, in file order
+const std::vector<FieldInfo> &fields();
+
+}  // namespace motor_log
+
+class MotorLogWriter {
+ public:
+    MotorLogWriter(std::string filename, std::vector<std::string> motor_names, uint32_t segment_records = 4096);
+    ~MotorLogWriter();
+    // stage one record, statuses and commands have one entry per motor. Every
+    // segment_records records this encodes and maps a segment, so call it off
+    // the realtime thread, as MotorRecorder does
+    void write(int64_t time_ns, const Status *statuses, const Command *commands);
+    // encode staged records into the next segment
+    void flush();
+ private:
+    void grow();
+    int fd_;
+    std::string filename_;
+    motor_log::FileHeader *header_;
+    uint32_t num_motors_;
+    uint32_t segment_records_;
+    size_t offset_;             // of the next segment
+    size_t allocated_ = 0;
+    std::vector<int64_t> times_;
+    std::vector<Status> statuses_;
+    std::vector<Command> commands_;
+};
+
+class MotorLogReader {
+ public:
+    MotorLogReader(std::string filename);
+    ~MotorLogReader();
+    uint32_t num_motors() const { return header_->num_motors; }
+    std::vector<std::string> motor_names() const;
+    uint64_t num_records() const { return header_->num_records; }
+    uint64_t num_segments() const { return segments_.size(); }
+    // the fields in this file, in file order, which can differ from the
+    // fields this build writes
+    const std::vector<motor_log::FieldInfo> &fields() const { return fields_; }
+    // the segment that contains time_ns, or the first one after it
+    uint64_t find_segment(int64_t time_ns) const;
+    // decode one segment, statuses and commands are record major with
+    // num_motors() entries per record
+    void read_segment(uint64_t segment, std::vector<int64_t> *times,
+        std::vector<Status> *statuses, std::vector<Command> *commands) const;
+ private:
+    const motor_log::SegmentHeader *segment(uint64_t i) const;
+    int fd_;
+    size_t size_;
+    const char *data_;
+    const motor_log::FileHeader *header_;
+    std::vector<motor_log::FieldInfo> fields_;
+    std::vector<const motor_log::SegmentHeader *> segments_;
+};
@@ -2,14 +2,20 @@
 #define MOTOR_MANAGER_H
 
 #include <vector>
+#include <map>
 #include <memory>
 #include <string>
 #include <ostream>
 #include <iomanip>
 #include <chrono>
+#include <poll.h>
 class Motor;
+class MotorIOUring;
+class MotorHotplug;
 
 #include "motor.h"
+#include "motor_errors.h"
+#include "motor_parameter_set.h"
 
 class FrequencyLimiter {
  public:
@@ -40,26 +46,74 @@ class MotorManager {
     std::vector<std::shared_ptr<Motor>> get_motors_by_path(std::vector<std::string> paths, bool connect = true, bool allow_simulated = false);
     std::vector<std::shared_ptr<Motor>> get_motors_by_devpath(std::vector<std::string> devpaths, bool connect = true, bool allow_simulated = false);
     std::vector<std::shared_ptr<Motor>> motors() const { return motors_; }
-    void set_motors(std::vector<std::shared_ptr<Motor>> motors) { motors_ = motors; commands_.resize(motors_.size()); }
-    std::vector<Command> commands() const { return commands_; }
-    std::vector<Status> read();
-    void write(std::vector<Command>);
+    void set_motors(std::vector<std::shared_ptr<Motor>> motors);
+    // the returned buffers are owned by MotorManager and reused every cycle
+    const std::vector<Command> &commands() const { return commands_; }
+    const std::vector<Status> &read();
+    // read into a caller owned array of at least motors().size()
+    void read(Status *statuses);
+    void write(const std::vector<Command> &commands);
     void write_saved_commands();
     void aread();
     int poll();
+    // Time budget for the motors to answer, zero to wait as long as they
+    // take. read() waits at most the budget from aread(), or from read()
+    // without aread(). write() waits at most the budget for the last writes
+    // and skips the command of a motor whose last write is unfinished. Kernel
+    // driver writes are not bounded.
+    void set_io_budget(std::chrono::nanoseconds budget) { io_budget_ = budget; }
+    // Motor i's status is not from the last read(), because it was late or
+    // disconnected. read() then leaves its status unchanged.
+    bool stale(int i) const { return stale_[i]; }
+    // I/O errors of motor i, safe from any thread. Reads and writes do not
+    // throw, failures are counted here, see MotorErrorReporter.
+    MotorErrorCounts errors(int i) const { return errors_[i].counts(); }
+    std::vector<MotorErrorCounts> errors() const;
+
+    // Run batches[i] on motor i, on all motors at once. Each motor's batch is
+    // one transaction, and motors do not wait for each other. The first
+    // motor's exception is rethrown once all are done, unless errors is
+    // given, which then gets each motor's error message, empty if it
+    // succeeded, and the values of a failed motor are empty.
+    std::vector<std::vector<TextAPIValue>> run_text(const std::vector<TextAPIBatch> &batches,
+        std::vector<std::chrono::nanoseconds> *times = nullptr, std::vector<std::string> *errors = nullptr);
+    // the same names from every motor
+    std::vector<std::vector<TextAPIValue>> get_text(const std::vector<std::string> &names);
+    // Read names from every motor at once. reports, if given, gets each
+    // motor's time and any empty replies, or the error of a motor that
+    // failed, whose set then has no values.
+    std::vector<MotorParameterSet> snapshot_parameters(const std::vector<std::string> &names,
+        std::vector<MotorParameterReport> *reports = nullptr);
+    // Write each set to the motor with its serial number, or else its name,
+    // all motors at once. With verify the values are read back in the same
+    // transaction and differences reported. Replies to the writes are
+    // checked either way. A motor that fails is reported and does not stop
+    // the others. Motors without a set are left alone, sets without a motor
+    // or for a motor that already has one are reported and not written.
+    std::vector<MotorParameterReport> restore_parameters(const std::vector<MotorParameterSet> &sets, bool verify = true);
 
     void set_auto_count(bool on=true) { auto_count_ = on; }
     uint32_t get_auto_count() const { return count_; }
-    void set_reconnect(bool reconnect=true) { reconnect_ = reconnect; }
-    void set_commands(std::vector<Command> commands);
+    // Reconnect motors by usb path. A motor that fails to read is skipped,
+    // while the others keep running, until a background thread has opened
+    // its replacement, see MotorHotplug.
+    void set_reconnect(bool reconnect=true);
+    bool connected(int i) const;
+    uint64_t reconnects() const;
+    // null unless reconnecting, e.g. for FirmwareLog to follow replacements
+    std::shared_ptr<MotorHotplug> hotplug() const { return hotplug_; }
+    // batch reads and writes of kernel driver motors through io_uring
+    void set_io_uring(bool io_uring=true);
+    void set_commands(const std::vector<Command> &commands);
+    void set_commands(const Command *commands, size_t num_commands);
     void set_command_count(int32_t count);
     void set_command_mode(uint8_t mode);
-    void set_command_mode(std::vector<uint8_t> mode);
-    void set_command_current(std::vector<float> current);
-    void set_command_position(std::vector<float> position);
-    void set_command_velocity(std::vector<float> velocity);
-    void set_command_torque(std::vector<float> torque);
-    void set_command_reserved(std::vector<float> reserved);
+    void set_command_mode(const std::vector<uint8_t> &mode);
+    void set_command_current(const std::vector<float> &current);
+    void set_command_position(const std::vector<float> &position);
+    void set_command_velocity(const std::vector<float> &velocity);
+    void set_command_torque(const std::vector<float> &torque);
+    void set_command_reserved(const std::vector<float> &reserved);
     void set_command_stepper_tuning(TuningMode tuning_mode, 
          double amplitude, double frequency, double bias, double kv);
     void set_command_current_tuning(TuningMode tuning_mode, 
@@ -74,14 +128,34 @@ class MotorManager {
     int serialize_saved_commands(char *data) const;
     bool deserialize_saved_commands(char *data);
  private:
-    std::vector<std::shared_ptr<Motor>> get_motors_by_name_function(std::vector<std::string> names, std::string (Motor::*name_fun)() const, bool connect = true, bool allow_simulated = false);
+    void take_replacement();
+    std::chrono::steady_clock::time_point io_deadline() const;
+    void io_error(int i, int err);
+    // a motor device's identity as read from udev
+    struct DeviceInfo {
+        std::string dev_path, name, serial_number, base_path, version, devnum;
+    };
+    std::vector<DeviceInfo> udev();
+    std::vector<std::shared_ptr<Motor>> open_motors(const std::vector<DeviceInfo> &devices);
+    std::vector<std::shared_ptr<Motor>> get_motors_by_name_function(std::vector<std::string> names, std::string DeviceInfo::*field, bool connect = true, bool allow_simulated = false);
     std::vector<std::shared_ptr<Motor>> motors_;
     std::vector<Command> commands_;
+    std::vector<Status> statuses_;
+    std::vector<pollfd> pollfds_;
+    std::shared_ptr<MotorIOUring> io_uring_;
+    std::shared_ptr<MotorHotplug> hotplug_;
+    std::chrono::nanoseconds io_budget_ = std::chrono::nanoseconds(0);
+    std::chrono::steady_clock::time_point read_deadline_;
+    bool aread_started_ = false;
+    std::vector<bool> stale_;
+    std::vector<MotorErrors> errors_;
+    std::map<std::string, DeviceInfo> identity_cache_;                 // by dev_path
+    std::map<std::string, std::weak_ptr<Motor>> open_motors_;          // by dev_path:devnum
     bool user_space_driver_;
     uint32_t count_ = 0;
     bool auto_count_ = false;
     bool reconnect_ = false;
-    FrequencyLimiter reconnect_rate_ = std::chrono::milliseconds(100);
+    bool io_uring_enabled_ = false;
 };
 
 inline std::vector<float> get_joint_position(std::vector<Status> statuses) {
@@ -100,27 +174,27 @@ inline std::vector<float> get_motor_position(std::vector<Status> statuses) {
    return out;
 }
 
-inline std::ostream& operator<<(std::ostream& os, const std::vector<Command> command)
+inline std::ostream& operator<<(std::ostream& os, const std::vector<Command> &command)
 {
-   for (auto c : command) {
+   for (const auto &c : command) {
       os << c.host_timestamp << ", ";
    }
-   for (auto c : command) {
+   for (const auto &c : command) {
       os << +c.mode_desired << ", ";
    }
-   for (auto c : command) {
+   for (const auto &c : command) {
       os << c.current_desired << ", ";
    }
-   for (auto c : command) {
+   for (const auto &c : command) {
       os << c.position_desired << ", ";
    }
-   for (auto c : command) {
+   for (const auto &c : command) {
       os << c.velocity_desired << ", ";
    }
-   for (auto c : command) {
+   for (const auto &c : command) {
       os << c.torque_desired << ", ";
    }
-   for (auto c : command) {
+   for (const auto &c : command) {
       os << c.reserved << ", ";
    }
 
@@ -167,45 +241,45 @@ inline std::ostream& reserved_uint32(std::ostream &os) {
     return os;
 }
 
-inline std::ostream& operator<<(std::ostream& os, const std::vector<Status> status)
+inline std::ostream& operator<<(std::ostream& os, const std::vector<Status> &status)
 {
 
-   for (auto s : status) {
+   for (const auto &s : status) {
       os << std::setw(10) << s.mcu_timestamp << ", ";
    }
-   for (auto s : status) {
+   for (const auto &s : status) {
       os << s.host_timestamp_received << ", ";
    }
-   for (auto s : status) {
+   for (const auto &s : status) {
       os << std::setw(8) << s.motor_position << ", ";
    }
-   for (auto s : status) {
+   for (const auto &s : status) {
       os << std::setw(8) << s.joint_position << ", ";
    }
-   for (auto s : status) {
+   for (const auto &s : status) {
       os << std::setw(8) << s.iq << ", ";
    }
-   for (auto s : status) {
+   for (const auto &s : status) {
       os << std::setw(8) << s.torque << ", ";
    }
-   for (auto s : status) {
+   for (const auto &s : status) {
       os << s.motor_encoder << ", ";
    }
-   for (auto s : status) {
+   for (const auto &s : status) {
       os << s.reserved[0] << ", ";
    }
    if (os.iword(geti()) == 1) {
-      for (auto s : status) {
-         os << *reinterpret_cast<uint32_t *>(&s.reserved[1]) << ", ";
+      for (const auto &s : status) {
+         os << *reinterpret_cast<const uint32_t *>(&s.reserved[1]) << ", ";
       }
-      for (auto s : status) {
-         os << *reinterpret_cast<uint32_t *>(&s.reserved[2]) << ", ";
+      for (const auto &s : status) {
+         os << *reinterpret_cast<const uint32_t *>(&s.reserved[2]) << ", ";
       }
    } else {
-      for (auto s : status) {
+      for (const auto &s : status) {
          os << s.reserved[1] << ", ";
       }
-      for (auto s : status) {
+      for (const auto &s : status) {
          os << s.reserved[2] << ", ";
       }
    }
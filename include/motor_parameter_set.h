@@ -0,0 +1,37 @@
+#pragma once
+#include <chrono>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Text api parameter values of one motor, see
+// MotorManager::snapshot_parameters() and restore_parameters()
+struct MotorParameterSet {
+    std::string name, serial_number, version;
+    std::vector<std::pair<std::string, std::string>> values;
+};
+
+// As text, one motor after another separated by a blank line:
+//     motor=J1
+//     serial_number=...
+//     version=...
+//     kp=1.5
+// motor, serial_number and version are not parameters.
+void write_parameter_sets(std::ostream &os, const std::vector<MotorParameterSet> &sets);
+std::vector<MotorParameterSet> read_parameter_sets(std::istream &is);
+
+// The outcome of a snapshot or restore on one motor
+struct MotorParameterReport {
+    std::string name;
+    std::chrono::nanoseconds time = std::chrono::nanoseconds::zero();
+    size_t parameters = 0;
+    // empty or failed replies, read back values that differ from what was
+    // written, or the motor's transfer error
+    std::vector<std::string> errors;
+    bool ok() const { return errors.empty(); }
+};
+
+// "J1: 24 parameters in 31.2 ms" then any errors, one per line
+std::ostream &operator<<(std::ostream &os, const MotorParameterReport &report);
@@ -0,0 +1,54 @@
+#pragma once
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Motor;
+
+// Constant parameters of a motor, such as encoder counts per revolution,
+// read through the text api once and then served from memory. They are also
+// kept in a file per motor, keyed by serial number and firmware version, so
+// that the next process to open the motor does not read them again. The file
+// is only written for firmware that passes check_messages_version() and is
+// only used by builds with the same MOTOR_MESSAGES_VERSION.
+//
+// Only parameters registered as constants are cached, anything that can be
+// changed at runtime should be read through the text api.
+class MotorParameters {
+ public:
+    MotorParameters(Motor &motor);
+    // a constant parameter as a number, std::runtime_error if it is not a
+    // registered constant or not a number
+    double get(const std::string &name);
+    std::string get_string(const std::string &name);
+    // cache name as well, for parameters that only change with the firmware
+    void add_constant(const std::string &name);
+    bool constant(const std::string &name) const;
+    // drop the memory and file caches, the next get() reads the motor
+    void clear();
+    // $MOTOR_PARAMETER_CACHE, else $XDG_CACHE_HOME/motor_parameters, else
+    // ~/.cache/motor_parameters
+    static std::string cache_dir();
+    // empty for motors without a serial number or version, which are not
+    // cached on disk
+    std::string cache_path() const;
+ private:
+    struct Value {
+        std::string str;
+        bool is_number;
+        double number;
+    };
+    // with mutex_ held
+    const Value &value(const std::string &name);
+    bool is_constant(const std::string &name) const;
+    // reads all constants not yet known in one text api transaction
+    void load_from_motor();
+    void load_from_file();
+    void save();
+    Motor &motor_;
+    std::vector<std::string> constants_;
+    std::unordered_map<std::string, Value> values_;
+    bool file_loaded_ = false;
+    mutable std::mutex mutex_;
+};
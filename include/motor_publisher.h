@@ -5,36 +5,62 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <cerrno>
 #include <cstring>
+#include <stdexcept>
 #include "cstack.h"
 
+// Publishes T to a CStack<T> in shared memory named shm_name. Subscribers in
+// other processes can read any recent entry by sequence number or block until
+// the next publish(), see MotorSubscriber. By default the publisher creates
+// and removes the shared memory, with create false it publishes to shared
+// memory owned by a MotorSubscriber, as for CommandMailbox.
 template <class T>
 class MotorPublisher {
  public:
-    MotorPublisher(std::string shm_name = "motor_data") : shm_name_(shm_name) {
-        fd_ = shm_open(shm_name_.c_str(), O_RDWR  | O_CREAT, 0666);
-        ftruncate(fd_, sizeof(*data_));
+    MotorPublisher(std::string shm_name = "motor_data", bool create = true) : shm_name_(shm_name), create_(create) {
+        if (create_) {
+            fd_ = shm_open(shm_name_.c_str(), O_RDWR  | O_CREAT, 0666);
+            if (fd_ < 0 || ftruncate(fd_, sizeof(*data_))) {
+                throw std::runtime_error("Error creating shared memory " + shm_name_ + ": " + std::strerror(errno));
+            }
+        } else {
+            struct stat st;
+            fd_ = shm_open(shm_name_.c_str(), O_RDWR, 0666);
+            if (fd_ < 0 || fstat(fd_, &st) || st.st_size != sizeof(*data_)) {
+                throw std::runtime_error("Error opening shared memory " + shm_name_ + ", is the subscriber running?");
+            }
+        }
         memptr_ = mmap(NULL,       /* let system pick where to put segment */
                         sizeof(*data_),   /* how many bytes */
                         PROT_READ | PROT_WRITE, /* access protections */
                         MAP_SHARED, /* mapping visible to other processes */
                         fd_,         /* file descriptor */
                         0);
-        std::memset(memptr_, 0, 1000);
+        if (memptr_ == MAP_FAILED) {
+            throw std::runtime_error("Error mapping shared memory " + shm_name_ + ": " + std::strerror(errno));
+        }
+        if (create_) {
+            std::memset(memptr_, 0, sizeof(*data_));
+        }
         data_ = reinterpret_cast<CStack<T> *>(memptr_);
     }
     ~MotorPublisher() {
         munmap(memptr_, sizeof(*data_));
         close(fd_);
-        shm_unlink(shm_name_.c_str());
+        if (create_) {
+            shm_unlink(shm_name_.c_str());
+        }
     }
-    void publish(T data) {
+    void publish(T const &data) {
         data_->push(data);
         //std::strcpy((char *) memptr_, str.c_str());
     }
+    uint32_t sequence() const { return data_->sequence(); }
  private:
     int fd_;
     std::string shm_name_;
+    bool create_;
     void * memptr_;
     CStack<T> *data_;
 };
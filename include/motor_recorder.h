@@ -0,0 +1,112 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "motor_thread.h"
+#include "motor_log.h"
+#include "motor_format.h"
+#include "ring_buffer.h"
+#include "firmware_log.h"
+
+// Records every MotorThread cycle to a csv file or a binary MotorLogWriter
+// log. The realtime thread appends each cycle to a lock free queue and a
+// writer thread drains it in batches, so file io never runs in the control
+// loop. Cycles that arrive while the queue is full are counted in overflows().
+template <size_t N>
+class MotorRecorderN {
+ public:
+    MotorRecorderN(size_t capacity = 4096, size_t batch_size = 256) : buffer_(capacity), batch_(batch_size) {}
+    ~MotorRecorderN() { stop(); }
+    // the queue to give to MotorThreadN::set_record_buffer()
+    RingBuffer<CycleData<N>> &buffer() { return buffer_; }
+    void start(std::string filename, std::string headers) {
+        file_.rdbuf()->pubsetbuf(file_buffer_, sizeof(file_buffer_));
+        file_.open(filename);
+        file_ << headers << '\n';
+        done_ = false;
+        thread_ = std::thread([this]{ run(); });
+    }
+    // record to a binary log instead, see motor_log_export to convert to csv
+    void start_log(std::string filename, std::vector<std::string> motor_names) {
+        log_.reset(new MotorLogWriter(filename, motor_names));
+        done_ = false;
+        thread_ = std::thread([this]{ run(); });
+    }
+    // also record firmware log messages to filename as "host_time_ns, motor,
+    // text" lines, call before start()
+    void record_firmware_log(const FirmwareLog &firmware_log, std::string filename) {
+        firmware_log_.reset(new FirmwareLog::Reader(firmware_log.reader()));
+        firmware_log_file_.open(filename);
+    }
+    void stop() {
+        if (thread_.joinable()) {
+            done_ = true;
+            thread_.join();
+            file_.close();
+            log_.reset();
+            firmware_log_file_.close();
+        }
+    }
+    uint64_t recorded() const { return recorded_.load(std::memory_order_relaxed); }
+    uint64_t overflows() const { return buffer_.overflows(); }
+ private:
+    void run() {
+        MotorFormatter format;
+        while (true) {
+            bool done = done_;
+            size_t n = buffer_.pop(batch_.data(), batch_.size());
+            for (size_t i=0; i<n; i++) {
+                const CycleData<N> &data = batch_[i];
+                if (log_) {
+                    log_->write(data.time_start.time_since_epoch().count(), data.statuses, data.commands);
+                } else {
+                    format.append(static_cast<int64_t>(data.time_start.time_since_epoch().count())).append(", ")
+                          .append(data.commands, data.num_motors)
+                          .append(data.statuses, data.num_motors).append('\n');
+                }
+            }
+            if (n && !log_) {
+                file_.write(format.data(), format.size());
+                format.clear();
+            }
+            recorded_.fetch_add(n, std::memory_order_relaxed);
+            if (firmware_log_) {
+                FirmwareLogEntry entries[64];
+                while (size_t m = firmware_log_->read(entries, 64)) {
+                    for (size_t i=0; i<m; i++) {
+                        firmware_log_file_ << entries[i].host_time_ns << ", " << entries[i].motor << ", "
+                                           << entries[i].str() << '\n';
+                    }
+                }
+            }
+            if (n < batch_.size()) {
+                if (done) {
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        if (log_) {
+            log_->flush();
+        } else {
+            file_.flush();
+        }
+        firmware_log_file_.flush();
+    }
+    RingBuffer<CycleData<N>> buffer_;
+    std::vector<CycleData<N>> batch_;
+    std::ofstream file_;
+    std::unique_ptr<MotorLogWriter> log_;
+    std::unique_ptr<FirmwareLog::Reader> firmware_log_;
+    std::ofstream firmware_log_file_;
+    char file_buffer_[1 << 16];
+    std::thread thread_;
+    std::atomic<bool> done_ = {false};
+    std::atomic<uint64_t> recorded_ = {0};
+};
+
+typedef MotorRecorderN<MOTOR_THREAD_MAX_MOTORS> MotorRecorder;
@@ -5,39 +5,96 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <chrono>
+#include <cerrno>
 #include <cstring>
-#include <semaphore.h>
+#include <stdexcept>
+#include <thread>
 #include <cstack.h>
 
+// Reads a MotorPublisher<T> topic from shared memory. The topic is opened
+// read write so that wait() can register with the publisher. If the publisher
+// has not created the topic yet, or it has a different size than CStack<T>,
+// the subscriber retries opening it on each call. With create true the
+// subscriber creates and removes the topic instead, for publishers constructed
+// with create false.
 template <class T>
 class MotorSubscriber {
  public:
-    MotorSubscriber(std::string shm_name = "motor_data") : shm_name_(shm_name) {
-        fd_ = shm_open(shm_name_.c_str(), O_RDONLY, 0666);
-        if (fd_ > 0) {
-            memptr_ = mmap(NULL,       /* let system pick where to put segment */
-                        sizeof(*data_),   /* how many bytes */
-                        PROT_READ, /* access protections */
-                        MAP_SHARED, /* mapping visible to other processes */
-                        fd_,         /* file descriptor */
-                        0);
+    MotorSubscriber(std::string shm_name = "motor_data", bool create = false) : shm_name_(shm_name), create_(create) {
+        if (create_) {
+            int fd = shm_open(shm_name_.c_str(), O_RDWR | O_CREAT, 0666);
+            if (fd < 0 || ftruncate(fd, sizeof(*data_))) {
+                throw std::runtime_error("Error creating shared memory " + shm_name_ + ": " + std::strerror(errno));
+            }
+            close(fd);
+        }
+        open();
+        if (create_) {
+            if (!data_) {
+                throw std::runtime_error("Error mapping shared memory " + shm_name_ + ": " + std::strerror(errno));
+            }
+            std::memset(memptr_, 0, sizeof(*data_));
         }
-        data_ = reinterpret_cast<CStack<T> *>(memptr_);
     }
     ~MotorSubscriber() {
-        munmap(memptr_, sizeof(*data_));
-        close(fd_);
+        if (data_) {
+            munmap(memptr_, sizeof(*data_));
+        }
+        if (create_) {
+            shm_unlink(shm_name_.c_str());
+        }
     }
-    T read() {
+    bool connected() { return data_ || open(); }
+    // newest data, with its sequence number if seq is given
+    T read(uint32_t *seq = nullptr) {
         T data = {};
-        if (fd_ > 0) {
-            data = data_->top();
+        if (connected()) {
+            data_->top(&data, seq);
         }
         return data;
     }
+    // data for sequence number seq, see CStack::read()
+    typename CStack<T>::Result read(uint32_t seq, T *data) {
+        if (connected()) {
+            return data_->read(seq, data);
+        }
+        return CStack<T>::NOT_READY;
+    }
+    uint32_t sequence() {
+        return connected() ? data_->sequence() : 0;
+    }
+    // block until data newer than seq is published, false on timeout
+    bool wait(uint32_t seq, std::chrono::nanoseconds timeout) {
+        if (!connected()) {
+            std::this_thread::sleep_for(timeout);
+            return false;
+        }
+        return data_->wait(seq, timeout);
+    }
  private:
-    int fd_;
+    bool open() {
+        int fd = shm_open(shm_name_.c_str(), O_RDWR, 0666);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size == sizeof(*data_)) {
+            memptr_ = mmap(NULL,       /* let system pick where to put segment */
+                        sizeof(*data_),   /* how many bytes */
+                        PROT_READ | PROT_WRITE, /* access protections */
+                        MAP_SHARED, /* mapping visible to other processes */
+                        fd,         /* file descriptor */
+                        0);
+            if (memptr_ != MAP_FAILED) {
+                data_ = reinterpret_cast<CStack<T> *>(memptr_);
+            }
+        }
+        close(fd);
+        return data_;
+    }
     std::string shm_name_;
+    bool create_;
     void * memptr_;
-    CStack<T> * data_;
+    CStack<T> * data_ = nullptr;
 };
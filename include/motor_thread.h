@@ -4,29 +4,220 @@
 #include "motor.h"
 #include "motor_manager.h"
 #include <atomic>
+#include <algorithm>
+#include <type_traits>
 #include "cstack.h"
+#include "cycle_data.h"
+#include "ring_buffer.h"
+#include "motor_publisher.h"
+#include "command_mailbox.h"
+#include "malloc_check.h"
+#include "histogram.h"
+#include "perf_counters.h"
 
 class MotorManager;
 
-struct Data {
-    std::vector<Status> statuses;
-    std::vector<Command> commands;
-    std::chrono::steady_clock::time_point time_start, last_time_start, last_time_end, aread_time, read_time, control_time, write_time;
-};
-
-class MotorThread : public RealtimeThread {
+template <size_t N>
+class MotorThreadN : public RealtimeThread {
  public:
-    MotorThread(uint32_t frequency_hz = 1000);
-    const CStack<Data> &cstack() const { return cstack_; }
+    static_assert(std::is_trivially_copyable<CycleData<N>>::value, "CycleData must be trivially copyable");
+    MotorThreadN(uint32_t frequency_hz = 1000) : RealtimeThread(frequency_hz) {}
+    const CStack<CycleData<N>> &cstack() const { return cstack_; }
     void init();
     MotorManager& motor_manager() { return motor_manager_; }
+    // every cycle is also appended to buffer, e.g. MotorRecorderN::buffer()
+    void set_record_buffer(RingBuffer<CycleData<N>> *buffer) { record_buffer_ = buffer; }
+    // every cycle is also published to shared memory for other processes
+    void set_publisher(MotorPublisher<CycleData<N>> *publisher) { publisher_ = publisher; }
+    // apply the newest command set from another process before controller_update()
+    void set_command_mailbox(CommandMailboxN<N> *mailbox) { command_mailbox_ = mailbox; }
+    const CommandMailboxN<N> *command_mailbox() const { return command_mailbox_; }
+    // Pipelined cycles write the commands computed last cycle and start the
+    // next status read first, then run pre_update() and controller_update()
+    // on the statuses read last cycle while the transfers are in flight. The
+    // USB round trip overlaps the controller instead of adding to it, at the
+    // cost of one cycle more sensor to actuator latency. Each published cycle
+    // holds the statuses the controller used and the commands it computed.
+    // Must be called before run().
+    void set_pipelined(bool pipelined = true) { pipelined_ = pipelined; }
+    bool pipelined() const { return pipelined_; }
+    // ns from starting the status read to writing the commands computed from it
+    HistogramSnapshot sensor_to_actuator_latency() const { return sensor_to_actuator_.snapshot(); }
+    // Phases of update() that perf counters are recorded for
+    enum Phase { AREAD, PRE_UPDATE, READ, CONTROLLER_UPDATE, WRITE, POST_UPDATE };
+    // Record cycles, instructions, cache misses, context switches, page
+    // faults and migrations of each phase, falling back to the counters that
+    // are allowed. Adds a counter read per phase to the cycle. Must be called
+    // before run().
+    void set_perf_counters(bool enable = true) {
+        perf_counters_.reset(enable ? new PhaseCounters({"aread", "pre_update", "read", "controller_update",
+            "write", "post_update"}) : nullptr);
+    }
+    // empty unless set_perf_counters()
+    PhaseCountersSnapshot perf_counters() const {
+        return perf_counters_ ? perf_counters_->snapshot() : PhaseCountersSnapshot();
+    }
  protected:
     virtual void post_init() {}
     virtual void pre_update() {}
     virtual void controller_update() {}
     virtual void post_update() {}
     virtual void update();
-    Data data_;
+    void update_serial();
+    void update_pipelined();
+    void record_latency(std::chrono::steady_clock::time_point sensor_time);
+    void phase_end(Phase phase) {
+        if (perf_counters_) {
+            perf_counters_->end(phase);
+        }
+    }
+    CycleData<N> data_ = {};
     MotorManager motor_manager_;
-    CStack<Data> cstack_;
-};
\ No newline at end of file
+    CStack<CycleData<N>> cstack_;
+    RingBuffer<CycleData<N>> *record_buffer_ = nullptr;
+    MotorPublisher<CycleData<N>> *publisher_ = nullptr;
+    CommandMailboxN<N> *command_mailbox_ = nullptr;
+    bool pipelined_ = false;
+    bool commands_pending_ = false;
+    Status next_statuses_[N] = {};
+    uint8_t next_stale_[N] = {};
+    std::chrono::steady_clock::time_point next_sensor_time_, command_sensor_time_;
+    Histogram sensor_to_actuator_;
+    std::unique_ptr<PhaseCounters> perf_counters_;
+};
+
+typedef MotorThreadN<MOTOR_THREAD_MAX_MOTORS> MotorThread;
+extern template class MotorThreadN<MOTOR_THREAD_MAX_MOTORS>;
+
+template <size_t N>
+void MotorThreadN<N>::init() {
+    std::cout << "Connecting to motors:" << std::endl;
+    for (auto m : motor_manager_.motors()) {
+        std:: cout << m->name() << std::endl;
+    }
+    if (motor_manager_.motors().size() > N) {
+        throw std::runtime_error("Too many motors for MotorThread, maximum is " + std::to_string(N));
+    }
+    data_.num_motors = motor_manager_.motors().size();
+    post_init();
+}
+
+template <size_t N>
+void MotorThreadN<N>::update() {
+    MallocCheck malloc_check;
+    data_.last_time_start = data_.time_start;
+    data_.time_start = std::chrono::steady_clock::now();
+    if (perf_counters_) {
+        // counters count the thread that opens them
+        if (!perf_counters_->is_open()) {
+            perf_counters_->open();
+        }
+        perf_counters_->start();
+    }
+    if (pipelined_) {
+        update_pipelined();
+    } else {
+        update_serial();
+    }
+    std::copy(motor_manager_.commands().begin(), motor_manager_.commands().end(), data_.commands);
+
+    post_update();
+    phase_end(POST_UPDATE);
+    cstack_.push(data_);
+    if (record_buffer_) {
+        record_buffer_->push(data_);
+    }
+    if (publisher_) {
+        publisher_->publish(data_);
+    }
+    RealtimeThread::update();
+    data_.last_time_end = std::chrono::steady_clock::now();
+}
+
+template <size_t N>
+void MotorThreadN<N>::update_serial() {
+    // start a read on all motors
+    motor_manager_.aread();
+    data_.aread_time = std::chrono::steady_clock::now();
+    phase_end(AREAD);
+
+    // there is some time before data will return on USB, can do pre update work
+    pre_update();
+    phase_end(PRE_UPDATE);
+    // blocking io to get the data already set up and wait if not ready yet
+    motor_manager_.read(data_.statuses);
+    data_.read_time = std::chrono::steady_clock::now();
+    phase_end(READ);
+    for (size_t i=0; i<data_.num_motors; i++) {
+        data_.stale[i] = motor_manager_.stale(i);
+    }
+
+    if (command_mailbox_) {
+        if (const CommandSetN<N> *command_set = command_mailbox_->receive()) {
+            motor_manager_.set_commands(command_set->commands, command_set->num_motors);
+        }
+    }
+    controller_update();
+    data_.control_time = std::chrono::steady_clock::now();
+    phase_end(CONTROLLER_UPDATE);
+
+    motor_manager_.write_saved_commands();
+    data_.write_time = std::chrono::steady_clock::now();
+    phase_end(WRITE);
+    record_latency(data_.aread_time);
+}
+
+template <size_t N>
+void MotorThreadN<N>::update_pipelined() {
+    if (!commands_pending_) {
+        // first cycle, nothing has been computed yet so start from a fresh read
+        motor_manager_.aread();
+        next_sensor_time_ = std::chrono::steady_clock::now();
+        phase_end(AREAD);
+        motor_manager_.read(next_statuses_);
+        phase_end(READ);
+        for (size_t i=0; i<data_.num_motors; i++) {
+            next_stale_[i] = motor_manager_.stale(i);
+        }
+    } else {
+        // motors copy the commands, so the controller is free to change them
+        // while the write is in flight
+        motor_manager_.write_saved_commands();
+        phase_end(WRITE);
+        record_latency(command_sensor_time_);
+    }
+    data_.write_time = std::chrono::steady_clock::now();
+    std::copy(next_statuses_, next_statuses_ + data_.num_motors, data_.statuses);
+    std::copy(next_stale_, next_stale_ + data_.num_motors, data_.stale);
+    auto sensor_time = next_sensor_time_;
+
+    motor_manager_.aread();
+    data_.aread_time = next_sensor_time_ = std::chrono::steady_clock::now();
+    phase_end(AREAD);
+
+    pre_update();
+    phase_end(PRE_UPDATE);
+    if (command_mailbox_) {
+        if (const CommandSetN<N> *command_set = command_mailbox_->receive()) {
+            motor_manager_.set_commands(command_set->commands, command_set->num_motors);
+        }
+    }
+    controller_update();
+    data_.control_time = std::chrono::steady_clock::now();
+    phase_end(CONTROLLER_UPDATE);
+    command_sensor_time_ = sensor_time;
+    commands_pending_ = true;
+
+    motor_manager_.read(next_statuses_);
+    data_.read_time = std::chrono::steady_clock::now();
+    phase_end(READ);
+    for (size_t i=0; i<data_.num_motors; i++) {
+        next_stale_[i] = motor_manager_.stale(i);
+    }
+}
+
+template <size_t N>
+void MotorThreadN<N>::record_latency(std::chrono::steady_clock::time_point sensor_time) {
+    sensor_to_actuator_.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - sensor_time).count());
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "histogram.h"
+
+// Counters of the calling thread. Hardware counters come from the PMU
+// through perf_event_open and need it to be accessible, e.g. not in most
+// VMs and perf_event_paranoid <= 2. Without them the kernel software
+// counters are used, and without perf_event_open at all getrusage(),
+// the thread cpu clock and sched_getcpu(). At perf_event_paranoid 2 only
+// user space is counted, where there are no context switches or
+// migrations, so those two come from getrusage() and sched_getcpu().
+class PerfCounters {
+ public:
+    enum Counter { CYCLES, INSTRUCTIONS, CACHE_MISSES, TASK_CLOCK, CONTEXT_SWITCHES, PAGE_FAULTS, MIGRATIONS,
+                   kNumCounters };
+    // the best source that could be opened
+    enum Source { CLOSED, HARDWARE, SOFTWARE, RUSAGE };
+    struct Values {
+        uint64_t value[kNumCounters];
+    };
+    PerfCounters() {}
+    ~PerfCounters() { close(); }
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    // counts the calling thread from now on, no allocation
+    void open();
+    void close();
+    Source source() const { return static_cast<Source>(source_.load(std::memory_order_acquire)); }
+    bool available(Counter c) const { return available_.load(std::memory_order_acquire) & (1u << c); }
+    // current totals of the available counters, one syscall, values is
+    // left as it was on error
+    void read(Values *values);
+
+    // counters read from getrusage() and sched_getcpu() rather than perf
+    bool from_rusage(Counter c) const { return rusage_.load(std::memory_order_acquire) & (1u << c); }
+
+    static const char *name(Counter c);
+    static const char *source_name(Source s);
+ private:
+    bool read_rusage(Values *values, uint32_t counters);
+    int fds_[kNumCounters];
+    // position of each counter in a group read
+    int group_index_[kNumCounters];
+    int num_fds_ = 0;
+    int last_cpu_ = -1;
+    uint64_t migrations_ = 0;
+    std::atomic<int> source_ = {CLOSED};
+    std::atomic<uint32_t> available_ = {0};
+    std::atomic<uint32_t> rusage_ = {0};
+};
+
+// A copy of PhaseCounters
+struct PhaseCountersSnapshot {
+    std::string source;
+    std::vector<std::string> phases;
+    std::vector<std::string> counters;
+    // [phase][counter], per cycle counts
+    std::vector<std::vector<HistogramSnapshot>> histograms;
+};
+
+// one line per phase and counter with mean, p99 and max
+std::ostream &operator<<(std::ostream &os, const PhaseCountersSnapshot &s);
+
+// Per cycle counter histograms of each phase of a loop. The loop thread
+// calls open() once, then start() at the beginning of each cycle and end()
+// after each phase, which records the counts since the previous call.
+// Each call is one read() of the counter group, about 400 ns.
+class PhaseCounters {
+ public:
+    PhaseCounters(std::vector<std::string> phases);
+    void open();
+    bool is_open() const { return counters_.source() != PerfCounters::CLOSED; }
+    void start() { counters_.read(&last_); }
+    void end(int phase) {
+        // unchanged if the read fails
+        PerfCounters::Values now = last_;
+        counters_.read(&now);
+        for (int c=0; c<PerfCounters::kNumCounters; c++) {
+            if (available_ & (1u << c)) {
+                histograms_[phase * PerfCounters::kNumCounters + c].record(now.value[c] - last_.value[c]);
+            }
+        }
+        last_ = now;
+    }
+    PhaseCountersSnapshot snapshot() const;
+ private:
+    std::vector<std::string> phases_;
+    PerfCounters counters_;
+    PerfCounters::Values last_ = {};
+    uint32_t available_ = 0;
+    std::unique_ptr<Histogram[]> histograms_;
+};
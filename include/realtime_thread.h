@@ -3,27 +3,99 @@
 #include <future>
 #include <chrono>
 #include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "cycle_stats.h"
+#include "wake_timer.h"
 
 namespace std {
     class thread;
 }
 
+// How a RealtimeThread is scheduled. Zero runtime, deadline or period are
+// derived from the thread frequency. SCHED_DEADLINE cannot be combined with
+// a cpu affinity smaller than the root domain, so with cpus set a deadline
+// request normally ends up on the fifo fallback.
+struct RealtimeConfig {
+    enum Policy { DEADLINE, FIFO, RR, OTHER };
+    Policy policy = DEADLINE;
+    uint64_t runtime_ns = 0;        // default 0.9*period
+    uint64_t deadline_ns = 0;       // default 0.9*period
+    uint64_t period_ns = 0;         // loop period, default 1/frequency
+    int priority = 80;              // SCHED_FIFO and SCHED_RR priority
+    bool fifo_fallback = true;      // try SCHED_FIFO at priority if deadline fails
+    std::vector<int> cpus;          // affinity, empty to leave unchanged
+    bool lock_memory = true;        // mlockall before starting the thread
+    WakeTimer::Mode wake_mode = WakeTimer::SLEEP;   // how to wait when not SCHED_DEADLINE
+};
+
+// Timing of a task added with RealtimeThread::add_task()
+struct TaskStatsSnapshot {
+    std::string name;
+    uint32_t divisor;
+    uint32_t phase;
+    uint64_t runs;
+    HistogramSnapshot exec_time;        // ns per run
+};
+
+inline std::ostream &operator<<(std::ostream &os, const TaskStatsSnapshot &s) {
+    return os << "task " << s.name << " every " << s.divisor << " cycles, phase " << s.phase
+              << ", runs " << s.runs << "\n  exec time ns: " << s.exec_time;
+}
+
 class RealtimeThread {
  public:
-	RealtimeThread(uint32_t frequency_hz, std::function<void ()> update_fun = [](){}) 
+    static const int kAutoPhase = -1;
+
+	RealtimeThread(uint32_t frequency_hz, std::function<void ()> update_fun = [](){})
         : update_fun_(update_fun) {
 		period_ns_ = 1.0e9/frequency_hz;
 	}
+    // must be called before run()
+    void set_realtime_config(const RealtimeConfig &config) { config_ = config; }
+    const RealtimeConfig &realtime_config() const { return config_; }
+    // starts the thread and returns once its scheduling is set up
     void run();
 	void done();
+    // the policy that took effect, valid after run()
+    RealtimeConfig::Policy policy() const { return policy_; }
+    // a description of the scheduling that took effect and why, valid after run()
+    std::string scheduling_report() const { return report_; }
+    // wake latency, execution time and overruns of every cycle so far. Under
+    // SCHED_DEADLINE wake latency is from the previous wake plus the period.
+    CycleStatsSnapshot cycle_stats() const { return cycle_stats_.snapshot(); }
+    // Run fun on the realtime thread every divisor cycles, after update(), on
+    // the cycles where cycle % divisor == phase. kAutoPhase picks the phase
+    // that shares the fewest cycles with tasks already added. Must be called
+    // before run(), returns the task's index into task_stats().
+    size_t add_task(std::string name, uint32_t divisor, std::function<void ()> fun, int phase = kAutoPhase);
+    std::vector<TaskStatsSnapshot> task_stats() const;
  protected:
     virtual void update() { update_fun_(); }
     std::chrono::steady_clock::time_point start_time_;
  private:
     void run_deadline();
+    void set_scheduling();
+    void run_tasks();
+    struct ScheduledTask {
+        std::string name;
+        uint32_t divisor;
+        uint32_t phase;
+        std::function<void ()> fun;
+        Histogram exec_time;
+        std::atomic<uint64_t> runs = {0};
+    };
     std::thread *thread_;
 	uint32_t period_ns_;
     bool done_ = false;
     std::function<void ()> update_fun_;
     std::promise<void> exit_;
-};
\ No newline at end of file
+    std::promise<void> started_;
+    RealtimeConfig config_;
+    RealtimeConfig::Policy policy_ = RealtimeConfig::OTHER;
+    std::string report_;
+    CycleStats cycle_stats_;
+    std::vector<std::unique_ptr<ScheduledTask>> tasks_;
+    uint64_t cycle_ = 0;
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+
+// A lock free single producer, single consumer queue. Storage is allocated
+// in the constructor, after that push() and pop() never allocate. A push to a
+// full queue is dropped and counted rather than blocking the producer.
+template <class T>
+class RingBuffer {
+ public:
+    RingBuffer(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) {
+            size *= 2;
+        }
+        data_.resize(size);
+        mask_ = size - 1;
+    }
+    // producer only, false and counted as an overflow if full
+    bool push(T const &t) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) > mask_) {
+            overflows_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        data_[head & mask_] = t;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+    // consumer only, copies up to max entries into t and returns the count
+    size_t pop(T *t, size_t max) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t n = std::min(max, head_.load(std::memory_order_acquire) - tail);
+        for (size_t i=0; i<n; i++) {
+            t[i] = data_[(tail + i) & mask_];
+        }
+        tail_.store(tail + n, std::memory_order_release);
+        return n;
+    }
+    size_t size() const { return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire); }
+    size_t capacity() const { return mask_ + 1; }
+    uint64_t overflows() const { return overflows_.load(std::memory_order_relaxed); }
+ private:
+    std::vector<T> data_;
+    size_t mask_;
+    // producer and consumer indexes on separate cache lines
+    alignas(64) std::atomic<size_t> head_ = {0};
+    std::atomic<uint64_t> overflows_ = {0};
+    alignas(64) std::atomic<size_t> tail_ = {0};
+};
@@ -0,0 +1,113 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ring_buffer.h"
+
+class Motor;
+
+// A text api request small enough to pass through a RingBuffer
+struct TextAPIRequest {
+    static const size_t kMaxLength = 64;
+    uint32_t id;
+    uint8_t length;
+    char data[kMaxLength];
+};
+
+// The reply to a TextAPIRequest, id and motor are those of the request. ok
+// is false if the transfer failed, data is then the error.
+struct TextAPIReply {
+    static const size_t kMaxLength = 64;
+    uint32_t id;
+    uint16_t motor;
+    bool ok;
+    uint8_t length;
+    char data[kMaxLength];
+    std::string str() const { return std::string(data, length); }
+};
+
+// Runs text api requests on background threads, one per motor, so that
+// callers never wait for the motor. Each thread owns its motor's TextFile
+// while the service exists, so other text api use of those motors would
+// interleave with it. Requests to one motor run in the order they were sent
+// from each caller.
+//
+// The realtime thread gets a Channel before it starts, then sends and
+// receives without locks, allocation or waiting. A send costs a futex wake
+// syscall if the motor's thread is idle. E.g. in controller_update():
+//     channel_->send(0, "kp=1.5");
+//     TextAPIReply reply;
+//     while (channel_->receive(&reply)) { ... }
+// Other threads can use request(), which returns a future or calls back on
+// the motor's thread.
+class TextAPIService {
+ public:
+    // Wait-free queues between one caller thread and the motor threads
+    class Channel {
+     public:
+        // false if the request is too long or motor's queue is full. id is
+        // returned in the reply.
+        bool send(int motor, const char *request, uint32_t id = 0);
+        // the next reply from any motor, false if there is none. Costs a
+        // futex wake syscall if a request was waiting for room for its reply.
+        bool receive(TextAPIReply *reply);
+     private:
+        friend class TextAPIService;
+        Channel(TextAPIService *service, size_t capacity);
+        TextAPIService *service_;
+        // per motor, a deque as ring buffers cannot be moved
+        std::deque<RingBuffer<TextAPIRequest>> requests_;
+        std::deque<RingBuffer<TextAPIReply>> replies_;
+        size_t next_reply_ = 0;
+    };
+
+    TextAPIService(const std::vector<std::shared_ptr<Motor>> &motors);
+    ~TextAPIService();
+    TextAPIService(const TextAPIService &) = delete;
+    TextAPIService &operator=(const TextAPIService &) = delete;
+
+    // A new channel with room for capacity requests per motor in flight.
+    // Allocates, so call it before the realtime thread needs it. Channels
+    // live as long as the service.
+    Channel *channel(size_t capacity = 16);
+
+    // From threads that may allocate and lock. The future throws the
+    // transfer's std::runtime_error if it failed. An exception thrown by
+    // callback is printed to std::cerr and dropped.
+    std::future<std::string> request(int motor, std::string request);
+    void request(int motor, std::string request, std::function<void(const TextAPIReply &)> callback);
+
+    size_t size() const { return workers_.size(); }
+    uint64_t completed() const { return completed_.load(std::memory_order_relaxed); }
+ private:
+    static const int kMaxChannels = 16;
+    struct Pending {
+        std::string request;
+        std::function<void(const TextAPIReply &)> callback;
+    };
+    struct Worker {
+        std::shared_ptr<Motor> motor;
+        // futex word, incremented on every request
+        std::atomic<uint32_t> requests = {0};
+        std::atomic<int> sleeping = {0};
+        std::mutex mutex;
+        std::deque<Pending> pending;
+        std::thread thread;
+    };
+    void run(int motor);
+    void notify(int motor);
+    TextAPIReply transfer(int motor, const char *request, size_t length, uint32_t id);
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::mutex channels_mutex_;
+    std::unique_ptr<Channel> channels_[kMaxChannels];
+    std::atomic<int> num_channels_ = {0};
+    std::atomic<uint64_t> completed_ = {0};
+    std::atomic<bool> done_ = {false};
+};
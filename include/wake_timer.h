@@ -0,0 +1,35 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Waits for the start of the next cycle.
+//   SLEEP    clock_nanosleep to the deadline
+//   SPIN     busy wait on steady_clock
+//   HYBRID   clock_nanosleep to a margin before the deadline, then spin. The
+//            margin tracks the measured wake up error, growing quickly when a
+//            sleep wakes late and shrinking slowly otherwise.
+//   TIMERFD  block on a timerfd, fd() can also be polled with other sources
+class WakeTimer {
+ public:
+    enum Mode { SLEEP, SPIN, HYBRID, TIMERFD };
+    WakeTimer(Mode mode = SLEEP);
+    ~WakeTimer();
+    void wait_until(std::chrono::steady_clock::time_point t);
+    // TIMERFD: set the timer for t without waiting, fd() is readable after t
+    void arm(std::chrono::steady_clock::time_point t);
+    int fd() const { return fd_; }
+    Mode mode() const { return mode_; }
+    // HYBRID: current time spent spinning before each deadline
+    int64_t margin_ns() const { return margin_ns_; }
+    static std::string mode_name(Mode mode);
+ private:
+    void sleep_until(std::chrono::steady_clock::time_point t);
+    void spin_until(std::chrono::steady_clock::time_point t);
+    Mode mode_;
+    int fd_ = -1;
+    bool thread_setup_ = false;
+    int64_t margin_ns_ = 50000;
+    static const int64_t kMinMarginNs = 2000;
+    static const int64_t kMaxMarginNs = 500000;
+};
@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+"""Load a binary motor log written by MotorLogWriter into numpy arrays.
+
+    import motor_log
+    log = motor_log.load("data.mlog")
+    log["timestamp"]            # (records,) int64 ns
+    log["motor_position"]       # (records, motors)
+    log["motor_names"]
+
+See include/motor_log.h for the format.
+"""
+
+import struct
+import sys
+import numpy as np
+
+_FILE_HEADER = struct.Struct("<8s8I2Q")
+_FIELD_INFO = struct.Struct("<32s4BI")
+_SEGMENT_HEADER = struct.Struct("<4IQqq")
+_BLOCK_INFO = struct.Struct("<II")
+_MAGIC = b"MOTORLOG"
+_VERSION = 1
+_SEGMENT_MAGIC = 0x4d474553
+_TYPES = {0: np.uint8, 1: np.uint32, 2: np.int32, 3: np.int64, 4: np.float32}
+_RAW, _DELTA_VARINT = 0, 1
+
+
+def _page_round(size, page):
+    return (size + page - 1) // page * page
+
+
+def _varints(data):
+    b = np.frombuffer(data, np.uint8)
+    if len(b) == 0:
+        return np.zeros(0, np.uint64)
+    ends = np.flatnonzero(b < 0x80)
+    starts = np.concatenate(([0], ends[:-1] + 1))
+    shift = (np.arange(len(b)) - np.repeat(starts, ends - starts + 1)) * 7
+    v = (b & 0x7f).astype(np.uint64) << shift.astype(np.uint64)
+    return np.add.reduceat(v, starts)
+
+
+def _delta_decode(data):
+    z = _varints(data)
+    d = (z >> np.uint64(1)).astype(np.int64) ^ -(z & np.uint64(1)).astype(np.int64)
+    return np.cumsum(d)
+
+
+def load(filename, start_ns=None, end_ns=None):
+    """Return a dict of arrays, optionally only the segments that overlap
+    [start_ns, end_ns] in the log's timestamp."""
+    with open(filename, "rb") as f:
+        buf = f.read()
+    (magic, version, header_size, num_motors, num_fields, segment_records,
+     max_segment_size, page_size, _, num_segments, num_records) = _FILE_HEADER.unpack_from(buf, 0)
+    if magic != _MAGIC or version != _VERSION:
+        raise ValueError("not a motor log version %d: %s" % (_VERSION, filename))
+    offset = _FILE_HEADER.size
+    names = [buf[offset + 32*i:offset + 32*(i+1)].split(b"\0")[0].decode()
+             for i in range(num_motors)]
+    offset += 32*num_motors
+    fields = []
+    for i in range(num_fields):
+        name, type_, encoding, size, is_command, _ = _FIELD_INFO.unpack_from(buf, offset)
+        fields.append((name.split(b"\0")[0].decode(), type_, encoding))
+        offset += _FIELD_INFO.size
+
+    columns = {"timestamp": []}
+    for name, _, _ in fields:
+        columns[name] = []
+    offset = header_size
+    for s in range(num_segments):
+        if offset + _SEGMENT_HEADER.size > len(buf):
+            break
+        magic, size, n, _, first_record, first_ns, last_ns = _SEGMENT_HEADER.unpack_from(buf, offset)
+        if magic != _SEGMENT_MAGIC:
+            break
+        segment = offset
+        offset += _page_round(size, page_size)
+        if (start_ns is not None and last_ns < start_ns) or (end_ns is not None and first_ns > end_ns):
+            continue
+        blocks = segment + _SEGMENT_HEADER.size
+
+        def block(b):
+            o, size = _BLOCK_INFO.unpack_from(buf, blocks + b*_BLOCK_INFO.size)
+            return buf[segment + o:segment + o + size]
+
+        columns["timestamp"].append(_delta_decode(block(0)))
+        b = 1
+        for name, type_, encoding in fields:
+            motors = []
+            for j in range(num_motors):
+                if encoding == _DELTA_VARINT:
+                    v = _delta_decode(block(b)).astype(np.uint32)
+                    motors.append(v.view(_TYPES[type_]))
+                else:
+                    motors.append(np.frombuffer(block(b), _TYPES[type_]))
+                b += 1
+            columns[name].append(np.stack(motors, axis=1))
+
+    out = {}
+    for name, type_, _ in [("timestamp", 3, 0)] + fields:
+        if columns[name]:
+            out[name] = np.concatenate(columns[name])
+        elif name == "timestamp":
+            out[name] = np.zeros(0, np.int64)
+        else:
+            out[name] = np.zeros((0, num_motors), _TYPES[type_])
+    if start_ns is not None or end_ns is not None:
+        t = out["timestamp"]
+        keep = np.ones(len(t), bool)
+        if start_ns is not None:
+            keep &= t >= start_ns
+        if end_ns is not None:
+            keep &= t <= end_ns
+        for name in out:
+            out[name] = out[name][keep]
+    out["motor_names"] = names
+    return out
+
+
+if __name__ == "__main__":
+    log = load(sys.argv[1])
+    print("motors: " + ", ".join(log["motor_names"]))
+    print("records: %d" % len(log["timestamp"]))
+    if len(log["timestamp"]):
+        print("duration: %f s" % ((log["timestamp"][-1] - log["timestamp"][0])/1e9))
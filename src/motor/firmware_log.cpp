@@ -0,0 +1,139 @@
+#include "firmware_log.h"
+#include "motor.h"
+#include "motor_hotplug.h"
+#include <algorithm>
+#include <cstring>
+
+const size_t FirmwareLogEntry::kMaxLength;
+const int FirmwareLog::kCapacity;
+const size_t FirmwareLog::kMaxBatch;
+
+FirmwareLog::Reader::Reader(const FirmwareLog *log) : log_(log) {
+    for (auto &ring : log_->rings_) {
+        uint32_t seq = ring->sequence();
+        next_.push_back(seq >= kCapacity ? seq - kCapacity + 1 : 1);
+    }
+}
+
+size_t FirmwareLog::Reader::read(FirmwareLogEntry *entries, size_t max) {
+    size_t n = 0;
+    // one entry from each motor per round, so a busy motor does not crowd
+    // out the others
+    bool progress = true;
+    while (n < max && progress) {
+        progress = false;
+        for (size_t i=0; i<next_.size() && n < max; i++) {
+            const Ring &ring = *log_->rings_[i];
+            Ring::Result result = ring.read(next_[i], &entries[n]);
+            if (result == Ring::OK) {
+                next_[i]++;
+                n++;
+                progress = true;
+            } else if (result == Ring::LAPPED) {
+                // skip to the oldest entry still held
+                uint32_t oldest = ring.sequence() - kCapacity + 1;
+                if (static_cast<int32_t>(oldest - next_[i]) > 0) {
+                    lost_ += oldest - next_[i];
+                    next_[i] = oldest;
+                } else {
+                    // the slot is being written over, skip it and count it lost
+                    lost_++;
+                    next_[i]++;
+                }
+                progress = true;
+            }
+        }
+    }
+    return n;
+}
+
+FirmwareLog::FirmwareLog(const std::vector<std::shared_ptr<Motor>> &motors, std::chrono::milliseconds poll_period,
+                         std::shared_ptr<MotorHotplug> hotplug)
+        : motors_(motors), hotplug_(hotplug), poll_period_(poll_period), transactions_(new std::atomic<uint64_t>[motors.size()]) {
+    for (int i=0; i<motors_.size(); i++) {
+        rings_.emplace_back(new Ring);
+        transactions_[i] = 0;
+    }
+    for (int i=0; i<motors_.size(); i++) {
+        threads_.emplace_back([this, i]{ run(i); });
+    }
+}
+
+FirmwareLog::~FirmwareLog() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_ = true;
+    }
+    cv_.notify_all();
+    for (auto &thread : threads_) {
+        thread.join();
+    }
+}
+
+uint64_t FirmwareLog::entries() const {
+    uint64_t n = 0;
+    for (auto &ring : rings_) {
+        n += ring->sequence();
+    }
+    return n;
+}
+
+uint64_t FirmwareLog::transactions() const {
+    uint64_t n = 0;
+    for (int i=0; i<motors_.size(); i++) {
+        n += transactions_[i].load(std::memory_order_relaxed);
+    }
+    return n;
+}
+
+void FirmwareLog::run(int motor) {
+    Ring &ring = *rings_[motor];
+    size_t batch_size = 1;
+    // only this thread uses motors_[motor] once running
+    std::shared_ptr<Motor> &m = motors_[motor];
+    while (true) {
+        if (auto hotplug = hotplug_.lock()) {
+            m = hotplug->motor(motor);
+        }
+        TextAPIBatch batch = m->text_batch();
+        for (size_t i=0; i<batch_size; i++) {
+            batch.get("log");
+        }
+        size_t messages = 0;
+        try {
+            auto values = batch.run();
+            transactions_[motor].fetch_add(1, std::memory_order_relaxed);
+            auto now = std::chrono::steady_clock::now().time_since_epoch();
+            for (auto &v : values) {
+                // a message logged between two requests of the batch comes
+                // after a "log end" reply, and it is already off the motor
+                if (v.str.empty() || v.str == "log end") {
+                    continue;
+                }
+                FirmwareLogEntry entry;
+                entry.host_time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+                entry.motor = motor;
+                entry.length = std::min(v.str.size(), FirmwareLogEntry::kMaxLength);
+                std::memcpy(entry.text, v.str.data(), entry.length);
+                ring.push(entry);
+                messages++;
+            }
+        } catch (std::runtime_error &e) {
+            // e.g. disconnected, keep polling at the slow rate
+        }
+        if (messages == batch_size) {
+            // every reply was a message, possibly more waiting
+            batch_size = std::min(batch_size * 2, kMaxBatch);
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (done_) {
+                break;
+            }
+            continue;
+        }
+        batch_size = 1;
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (cv_.wait_for(lock, poll_period_, [this]{ return done_; })) {
+            break;
+        }
+    }
+}
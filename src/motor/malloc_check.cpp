@@ -0,0 +1,56 @@
+#include "malloc_check.h"
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+// glibc's own allocator entry points, these definitions interpose the public ones
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t nmemb, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+}
+
+// initial-exec so that the thread local itself never needs an allocation
+static thread_local bool check __attribute__((tls_model("initial-exec"))) = false;
+
+void malloc_check(bool on) {
+    check = on;
+}
+
+static void fail(const char *fun) {
+    static const char msg[] = " called from realtime thread\n";
+    check = false;
+    ::write(STDERR_FILENO, fun, strlen(fun));
+    ::write(STDERR_FILENO, msg, sizeof(msg) - 1);
+    abort();
+}
+
+extern "C" void *malloc(size_t size) {
+    if (check) {
+        fail("malloc");
+    }
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t nmemb, size_t size) {
+    if (check) {
+        fail("calloc");
+    }
+    return __libc_calloc(nmemb, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size) {
+    if (check) {
+        fail("realloc");
+    }
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void *ptr) {
+    if (check && ptr) {
+        fail("free");
+    }
+    __libc_free(ptr);
+}
@@ -1,5 +1,7 @@
 #include "motor.h"
 
+const size_t TextFile::kMaxLength;
+
 Motor::Motor(std::string dev_path) { 
     dev_path_ = dev_path; 
     struct udev *udev = udev_new();
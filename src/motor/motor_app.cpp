@@ -16,6 +16,7 @@
 #include <cmath>
 
 #include "motor_thread.h"
+#include "motor_recorder.h"
 #include <thread>
 
 #include <unistd.h>
@@ -26,7 +27,59 @@ sig_atomic_t volatile running = 1;
 
 MotorApp::MotorApp(int argc, char **argv, MotorThread *motor_thread) 
     : motor_thread_(motor_thread) {
-
+    // --log FILE records a binary motor log instead of data.csv
+    // --firmware-log FILE records the motors' firmware log messages
+    // --policy deadline|fifo|rr|other, --priority N, --cpu N (repeatable) and
+    // --wake sleep|spin|hybrid|timerfd set the realtime thread scheduling
+    // --pipelined overlaps the controller with USB transfers
+    // --perf-counters records perf counters per phase of each cycle
+    // --io-budget NS gives up on motors that have not answered within NS
+    RealtimeConfig config = motor_thread_->realtime_config();
+    for (int i=1; i<argc; i++) {
+        if (std::string(argv[i]) == "--pipelined") {
+            motor_thread_->set_pipelined();
+        } else if (std::string(argv[i]) == "--perf-counters") {
+            motor_thread_->set_perf_counters();
+        }
+    }
+    for (int i=1; i<argc-1; i++) {
+        std::string arg = argv[i], value = argv[i+1];
+        if (arg == "--log") {
+            log_filename_ = value;
+        } else if (arg == "--firmware-log") {
+            firmware_log_filename_ = value;
+        } else if (arg == "--policy") {
+            if (value == "deadline") {
+                config.policy = RealtimeConfig::DEADLINE;
+            } else if (value == "fifo") {
+                config.policy = RealtimeConfig::FIFO;
+            } else if (value == "rr") {
+                config.policy = RealtimeConfig::RR;
+            } else if (value == "other") {
+                config.policy = RealtimeConfig::OTHER;
+            } else {
+                throw std::runtime_error("Unknown policy " + value);
+            }
+        } else if (arg == "--io-budget") {
+            motor_thread_->motor_manager().set_io_budget(std::chrono::nanoseconds(std::stoll(value)));
+        } else if (arg == "--priority") {
+            config.priority = std::stoi(value);
+        } else if (arg == "--cpu") {
+            config.cpus.push_back(std::stoi(value));
+        } else if (arg == "--wake") {
+            bool found = false;
+            for (auto mode : {WakeTimer::SLEEP, WakeTimer::SPIN, WakeTimer::HYBRID, WakeTimer::TIMERFD}) {
+                if (value == WakeTimer::mode_name(mode)) {
+                    config.wake_mode = mode;
+                    found = true;
+                }
+            }
+            if (!found) {
+                throw std::runtime_error("Unknown wake mode " + value);
+            }
+        }
+    }
+    motor_thread_->set_realtime_config(config);
 }
 
 int MotorApp::run() {
@@ -37,13 +90,28 @@ int MotorApp::run() {
 	motor_manager.get_connected_motors();
     motor_thread_->init();
 	auto &cstack = motor_thread_->cstack();
+	std::vector<std::string> motor_names;
+	for (auto m : motor_manager.motors()) {
+		motor_names.push_back(m->name());
+	}
+	// before the recorder, which reads it
+	std::unique_ptr<FirmwareLog> firmware_log;
+	MotorRecorder recorder;
+	if (firmware_log_filename_.size()) {
+		firmware_log.reset(new FirmwareLog(motor_manager.motors(), std::chrono::milliseconds(10), motor_manager.hotplug()));
+		recorder.record_firmware_log(*firmware_log, firmware_log_filename_);
+	}
+	if (log_filename_.size()) {
+		recorder.start_log(log_filename_, motor_names);
+	} else {
+		recorder.start("data.csv", "timestamp, " + motor_manager.command_headers() + motor_manager.status_headers());
+	}
+	motor_thread_->set_record_buffer(&recorder.buffer());
+	MotorErrorReporter error_reporter(motor_names);
 	
 	motor_thread_->run();
+	std::cout << "realtime thread: " << motor_thread_->scheduling_report() << std::endl;
 	std::chrono::steady_clock::time_point system_start = std::chrono::steady_clock::now();
-	std::ofstream file;
-	file.open("data.csv");
-	file << "timestamp, " << std::endl;
-
 
 	signal(SIGINT, [] (int signum) {running = 0;});
 
@@ -54,10 +122,8 @@ int MotorApp::run() {
 		Data data = cstack.top();
 		int32_t count = 0;
 		int32_t count_received = 0;
-		if(data.commands.size()) {
+		if(data.num_motors) {
 			count = data.commands[0].host_timestamp;
-		}
-		if(data.statuses.size()) {
 			count_received = data.statuses[0].host_timestamp_received;
 		}
 		auto last_exec = std::chrono::duration_cast<std::chrono::nanoseconds>(data.last_time_end - data.last_time_start).count();
@@ -69,15 +135,35 @@ int MotorApp::run() {
 				<< " read_time: " << std::chrono::duration_cast<std::chrono::nanoseconds>(data.read_time - data.time_start).count()
 				<< " control_exec: " << std::chrono::duration_cast<std::chrono::nanoseconds>(data.control_time - data.read_time).count()
 				<< " write_time: " << std::chrono::duration_cast<std::chrono::nanoseconds>(data.write_time - data.time_start).count()
-				<< std::endl;
-			
-		for (int j=0; j<500; j++) {
-			data = cstack.top();
-			file << data.time_start.time_since_epoch().count() << ", " << data.commands << data.statuses << std::endl;
-			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				<< " recorded: " << recorder.recorded() << " dropped: " << recorder.overflows();
+		CycleStatsSnapshot stats = motor_thread_->cycle_stats();
+		std::cout << " overruns: " << stats.overruns << " wake_p99.99: " << stats.wake_latency.percentile(.9999)
+				<< " exec_p99.99: " << stats.exec_time.percentile(.9999)
+				<< " sensor_to_actuator_p99: " << motor_thread_->sensor_to_actuator_latency().percentile(.99);
+		if (auto mailbox = motor_thread_->command_mailbox()) {
+			std::cout << " commands received: " << mailbox->received() << " stale: " << mailbox->stale()
+					<< " overwritten: " << mailbox->overwritten();
 		}
+		std::cout << std::endl;
+		std::cerr << error_reporter.report(motor_manager.errors());
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
 	}
 	motor_thread_->done();
+	motor_thread_->set_record_buffer(nullptr);
+	recorder.stop();
+	std::cout << motor_thread_->cycle_stats() << std::endl;
+	std::cout << "sensor to actuator ns: " << motor_thread_->sensor_to_actuator_latency() << std::endl;
+	auto errors = motor_manager.errors();
+	for (int i=0; i<errors.size(); i++) {
+		std::cout << motor_names[i] << " errors: " << errors[i].total() << " " << errors[i] << std::endl;
+	}
+	for (auto &task : motor_thread_->task_stats()) {
+		std::cout << task << std::endl;
+	}
+	auto perf_counters = motor_thread_->perf_counters();
+	if (perf_counters.phases.size()) {
+		std::cout << perf_counters << std::endl;
+	}
 
 	printf("main dies [%ld]\n", gettid());
     return 0;
@@ -1,20 +1,49 @@
 #include "motor_subscriber.h"
-#include <thread>
+#include "cycle_data.h"
+#include "motor_format.h"
 #include <iostream>
+#include <string>
 
-struct cstr{char s[100];};
-
+// Print every cycle published by motor_util read --publish or a MotorThread
+// publisher. Blocks until each new cycle rather than polling.
 int main(int argc, char** argv) {
-    MotorSubscriber<cstr> sub;
+    bool all = argc > 1 && std::string(argv[1]) == "--all";
+    MotorSubscriber<Data> sub;
+    MotorFormatter format;
+    format.set_fixed();
+    format.set_precision(5);
+    uint32_t seq = sub.sequence();
+    uint64_t lapped = 0;
     while(1) {
-        std::string str = sub.read().s;
-        if (str.size()) {
-            std::cout << str;
-        } else {
+        if (!sub.wait(seq, std::chrono::seconds(1))) {
             std::cout << "no data" << std::endl;
+            seq = sub.sequence();
+            continue;
+        }
+        uint32_t newest = sub.sequence();
+        for (seq++; static_cast<int32_t>(newest - seq) >= 0; seq++) {
+            Data data;
+            if (sub.read(seq, &data) != CStack<Data>::OK) {
+                lapped++;
+                continue;
+            }
+            format.clear();
+            format.append(seq).append(", ");
+            if (all) {
+                format.append(data.commands, data.num_motors).append(data.statuses, data.num_motors);
+            } else {
+                for (uint32_t i=0; i<data.num_motors; i++) {
+                    format.append(static_cast<double>(data.statuses[i].joint_position)).append(", ");
+                }
+            }
+            format.append('\n');
+            std::cout.write(format.data(), format.size());
+        }
+        seq = newest;
+        std::cout.flush();
+        if (lapped) {
+            std::cerr << "missed " << lapped << " cycles" << std::endl;
+            lapped = 0;
         }
-        
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
     }
-
-}
\ No newline at end of file
+}
@@ -0,0 +1,251 @@
+#include "motor_format.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+static const char kDigits[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const uint64_t kPow10[] = {1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull,
+    10000000ull, 100000000ull, 1000000000ull, 10000000000ull};
+
+// write u to the end of a 20 char buffer ending at end, return the start
+static char *format_uint(uint64_t u, char *end) {
+    char *p = end;
+    while (u >= 100) {
+        unsigned i = (u % 100) * 2;
+        u /= 100;
+        *--p = kDigits[i + 1];
+        *--p = kDigits[i];
+    }
+    if (u >= 10) {
+        unsigned i = u * 2;
+        *--p = kDigits[i + 1];
+        *--p = kDigits[i];
+    } else {
+        *--p = '0' + u;
+    }
+    return p;
+}
+
+char *MotorFormatter::reserve(size_t n) {
+    if (size_ + n > buffer_.size()) {
+        buffer_.resize(std::max(2*buffer_.size(), size_ + n));
+    }
+    return buffer_.data() + size_;
+}
+
+static size_t copy_padded(char *dst, const char *s, size_t n, int width) {
+    size_t pad = width > static_cast<int>(n) ? width - n : 0;
+    std::memset(dst, ' ', pad);
+    std::memcpy(dst + pad, s, n);
+    return pad + n;
+}
+
+MotorFormatter &MotorFormatter::append(uint64_t u, int width) {
+    char tmp[24];
+    char *end = tmp + sizeof(tmp);
+    char *p = format_uint(u, end);
+    size_ += copy_padded(reserve(std::max<size_t>(width, end - p)), p, end - p, width);
+    return *this;
+}
+
+MotorFormatter &MotorFormatter::append(int64_t i, int width) {
+    char tmp[24];
+    char *end = tmp + sizeof(tmp);
+    char *p = format_uint(i < 0 ? 0 - static_cast<uint64_t>(i) : i, end);
+    if (i < 0) {
+        *--p = '-';
+    }
+    size_ += copy_padded(reserve(std::max<size_t>(width, end - p)), p, end - p, width);
+    return *this;
+}
+
+MotorFormatter &MotorFormatter::append(uint32_t u, int width) {
+    return append(static_cast<uint64_t>(u), width);
+}
+
+MotorFormatter &MotorFormatter::append(int32_t i, int width) {
+    return append(static_cast<int64_t>(i), width);
+}
+
+// d with precision decimals into tmp, or -1 if printf is needed to round it
+// the same way
+int MotorFormatter::format_fixed(double d, int precision, char *tmp, size_t size) {
+    double a = std::fabs(d);
+    if (precision < 0 || precision > 10 || !(a < 1e15)) {
+        // nan, inf, very large or very precise
+        return -1;
+    }
+    double scale = kPow10[precision];
+    uint64_t integer = static_cast<uint64_t>(a);
+    double scaled = (a - integer) * scale;
+    double rounded = std::nearbyint(scaled);
+    if (std::fabs(std::fabs(scaled - rounded) - 0.5) < 1e-5) {
+        // too close to a tie to know which way the exact value rounds
+        return -1;
+    }
+    uint64_t fraction = static_cast<uint64_t>(rounded);
+    if (fraction >= scale) {
+        integer++;
+        fraction -= scale;
+    }
+    char *end = tmp + size;
+    char *p = end;
+    if (precision > 0) {
+        for (int k=0; k<precision; k++) {
+            *--p = '0' + fraction % 10;
+            fraction /= 10;
+        }
+        *--p = '.';
+    }
+    p = format_uint(integer, p);
+    if (std::signbit(d)) {
+        *--p = '-';
+    }
+    int n = end - p;
+    std::memmove(tmp, p, n);
+    return n;
+}
+
+// d as %g with precision_ significant digits, or -1 if printf is needed
+int MotorFormatter::format_general(double d, char *tmp, size_t size) {
+    int precision = precision_ < 0 ? 6 : precision_ == 0 ? 1 : precision_;
+    double a = std::fabs(d);
+    if (a == 0) {
+        return format_fixed(d, 0, tmp, size);
+    }
+    if (!(a >= 1e-4 && a < 1e15)) {
+        // nan, inf or exponent notation
+        return -1;
+    }
+    int exponent = static_cast<int>(std::floor(std::log10(a)));
+    int n = format_fixed(d, precision - 1 - exponent, tmp, size);
+    if (n < 0) {
+        return -1;
+    }
+    int lead = std::signbit(d) ? 1 : 0;
+    int integer_digits = 0;
+    while (lead + integer_digits < n && tmp[lead + integer_digits] != '.') {
+        integer_digits++;
+    }
+    // %g uses exponent notation once the rounded value has more integer
+    // digits than significant digits
+    if (integer_digits > precision) {
+        return -1;
+    }
+    if (lead + integer_digits < n) {
+        // and drops trailing zeros and a trailing point
+        while (tmp[n - 1] == '0') {
+            n--;
+        }
+        if (tmp[n - 1] == '.') {
+            n--;
+        }
+    }
+    return n;
+}
+
+MotorFormatter &MotorFormatter::append(double d, int width) {
+    // room for any double in fixed point at the default precision
+    char tmp[384];
+    int n = fixed_ ? format_fixed(d, precision_, tmp, sizeof(tmp)) : format_general(d, tmp, sizeof(tmp));
+    if (n < 0) {
+        int precision = precision_ < 0 ? 6 : precision_;
+        n = snprintf(tmp, sizeof(tmp), fixed_ ? "%.*f" : "%.*g", precision, d);
+        if (n < 0 || n >= static_cast<int>(sizeof(tmp))) {
+            n = snprintf(tmp, sizeof(tmp), "%g", d);
+        }
+    }
+    size_ += copy_padded(reserve(std::max(width, n)), tmp, n, width);
+    return *this;
+}
+
+MotorFormatter &MotorFormatter::append(const char *s) {
+    size_t n = std::strlen(s);
+    std::memcpy(reserve(n), s, n);
+    size_ += n;
+    return *this;
+}
+
+MotorFormatter &MotorFormatter::append(char c) {
+    *reserve(1) = c;
+    size_++;
+    return *this;
+}
+
+MotorFormatter &MotorFormatter::append(const Command *c, size_t n) {
+    for (size_t i=0; i<n; i++) {
+        append(c[i].host_timestamp).separator();
+    }
+    for (size_t i=0; i<n; i++) {
+        append(static_cast<uint32_t>(c[i].mode_desired)).separator();
+    }
+    for (size_t i=0; i<n; i++) {
+        append(static_cast<double>(c[i].current_desired)).separator();
+    }
+    for (size_t i=0; i<n; i++) {
+        append(static_cast<double>(c[i].position_desired)).separator();
+    }
+    for (size_t i=0; i<n; i++) {
+        append(static_cast<double>(c[i].velocity_desired)).separator();
+    }
+    for (size_t i=0; i<n; i++) {
+        append(static_cast<double>(c[i].torque_desired)).separator();
+    }
+    for (size_t i=0; i<n; i++) {
+        append(static_cast<double>(c[i].reserved)).separator();
+    }
+    return *this;
+}
+
+MotorFormatter &MotorFormatter::append(const Status *s, size_t n) {
+    int w10 = aligned_ ? 10 : 0, w8 = aligned_ ? 8 : 0;
+    for (size_t i=0; i<n; i++) {
+        append(s[i].mcu_timestamp, w10).separator();
+    }
+    for (size_t i=0; i<n; i++) {
+        append(s[i].host_timestamp_received).separator();
+    }
+    for (size_t i=0; i<n; i++) {
+        append(static_cast<double>(s[i].motor_position), w8).separator();
+    }
+    for (size_t i=0; i<n; i++) {
+        append(static_cast<double>(s[i].joint_position), w8).separator();
+    }
+    for (size_t i=0; i<n; i++) {
+        append(static_cast<double>(s[i].iq), w8).separator();
+    }
+    for (size_t i=0; i<n; i++) {
+        append(static_cast<double>(s[i].torque), w8).separator();
+    }
+    for (size_t i=0; i<n; i++) {
+        append(s[i].motor_encoder).separator();
+    }
+    for (size_t i=0; i<n; i++) {
+        append(static_cast<double>(s[i].reserved[0])).separator();
+    }
+    for (int r=1; r<3; r++) {
+        for (size_t i=0; i<n; i++) {
+            if (reserved_uint32_) {
+                uint32_t u;
+                std::memcpy(&u, &s[i].reserved[r], sizeof(u));
+                append(u);
+            } else {
+                append(static_cast<double>(s[i].reserved[r]));
+            }
+            separator();
+        }
+    }
+    return *this;
+}
@@ -0,0 +1,73 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include "motor_manager.h"
+#include "motor_format.h"
+
+// Compare MotorFormatter with the std::vector<Status>/<Command> stream
+// operators on the rows motor_util read and MotorRecorder write.
+int main(int argc, char **argv) {
+    int num_motors = argc > 1 ? std::stoi(argv[1]) : 6;
+    int rows = argc > 2 ? std::stoi(argv[2]) : 100000;
+
+    std::mt19937 gen(0);
+    std::uniform_real_distribution<float> dist(-100, 100);
+    std::vector<Status> statuses(num_motors);
+    std::vector<Command> commands(num_motors);
+    for (int i=0; i<num_motors; i++) {
+        Status &s = statuses[i];
+        s.mcu_timestamp = gen();
+        s.host_timestamp_received = gen();
+        s.motor_position = dist(gen);
+        s.joint_position = dist(gen);
+        s.iq = dist(gen);
+        s.torque = dist(gen);
+        s.motor_encoder = gen();
+        s.reserved[0] = dist(gen);
+        s.reserved[1] = dist(gen);
+        s.reserved[2] = dist(gen);
+        Command &c = commands[i];
+        c = {};
+        c.host_timestamp = gen();
+        c.mode_desired = POSITION;
+        c.position_desired = dist(gen);
+        c.velocity_desired = dist(gen);
+    }
+
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(5) << reserved_uint32;
+    auto start = std::chrono::steady_clock::now();
+    size_t stream_bytes = 0;
+    for (int i=0; i<rows; i++) {
+        oss << commands << statuses << '\n';
+        if (i % 1000 == 999) {
+            stream_bytes += oss.str().size();
+            oss.str("");
+        }
+    }
+    double stream_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    MotorFormatter format;
+    format.set_fixed();
+    format.set_precision(5);
+    format.set_aligned();
+    format.set_reserved_uint32();
+    start = std::chrono::steady_clock::now();
+    size_t format_bytes = 0;
+    for (int i=0; i<rows; i++) {
+        format.append(commands).append(statuses).append('\n');
+        if (i % 1000 == 999) {
+            format_bytes += format.size();
+            format.clear();
+        }
+    }
+    double format_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << num_motors << " motors, " << rows << " rows" << std::endl;
+    std::cout << "stream operators: " << stream_ns/rows << " ns/row, " << stream_bytes << " bytes" << std::endl;
+    std::cout << "MotorFormatter:   " << format_ns/rows << " ns/row, " << format_bytes << " bytes" << std::endl;
+    std::cout << "speedup: " << stream_ns/format_ns << std::endl;
+    return 0;
+}
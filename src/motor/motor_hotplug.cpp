@@ -0,0 +1,255 @@
+#include "motor_hotplug.h"
+#include "motor.h"
+#include "motor_io_uring.h"
+
+#include <libudev.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+// a motor that fails without its device going away is retried after this
+static const std::chrono::seconds kRetryTime(1);
+
+MotorHotplug::MotorHotplug(const std::vector<std::shared_ptr<Motor>> &motors, bool user_space_driver, bool io_uring)
+        : user_space_driver_(user_space_driver), io_uring_(io_uring), motors_(motors),
+          state_(new std::atomic<int>[motors.size()]), seen_disconnected_(motors.size()),
+          removed_(motors.size()), next_attempt_(motors.size()) {
+    for (int i=0; i<motors_.size(); i++) {
+        base_paths_.push_back(motors_[i]->base_path());
+        state_[i] = CONNECTED;
+    }
+    udev_ = udev_new();
+    if (udev_) {
+        monitor_ = udev_monitor_new_from_netlink(udev_, "udev");
+    }
+    if (!monitor_) {
+        if (udev_) {
+            udev_unref(udev_);
+        }
+        throw std::runtime_error("Error creating udev monitor");
+    }
+    udev_monitor_filter_add_match_subsystem_devtype(monitor_, user_space_driver_ ? "usb" : "usbmisc",
+        user_space_driver_ ? "usb_device" : NULL);
+    udev_monitor_enable_receiving(monitor_);
+    event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd_ < 0) {
+        udev_monitor_unref(monitor_);
+        udev_unref(udev_);
+        throw std::runtime_error("eventfd error " + std::to_string(errno) + ": " + strerror(errno));
+    }
+    // after enabling the monitor so that nothing is missed in between
+    scan();
+    thread_ = std::thread([this]{ run(); });
+}
+
+MotorHotplug::~MotorHotplug() {
+    done_ = true;
+    notify();
+    thread_.join();
+    udev_monitor_unref(monitor_);
+    udev_unref(udev_);
+    ::close(event_fd_);
+}
+
+void MotorHotplug::notify() {
+    uint64_t one = 1;
+    ssize_t retval = ::write(event_fd_, &one, sizeof(one));
+    (void) retval;
+}
+
+void MotorHotplug::disconnected(int i) {
+    int expected = CONNECTED;
+    if (state_[i].compare_exchange_strong(expected, DISCONNECTED, std::memory_order_acq_rel)) {
+        notify();
+    }
+}
+
+std::shared_ptr<Motor> MotorHotplug::motor(int i) const {
+    std::lock_guard<std::mutex> lock(motors_mutex_);
+    return motors_[i];
+}
+
+bool MotorHotplug::take(std::vector<std::shared_ptr<Motor>> &motors, std::shared_ptr<MotorIOUring> &io_uring) {
+    if (swap_state_.load(std::memory_order_acquire) != READY) {
+        return false;
+    }
+    // the old motor and ring go back to the background thread to be destroyed
+    std::swap(motors[swap_index_], swap_motor_);
+    if (swap_io_uring_) {
+        std::swap(io_uring, swap_io_uring_);
+    }
+    state_[swap_index_].store(CONNECTED, std::memory_order_release);
+    swap_state_.store(TAKEN, std::memory_order_release);
+    notify();
+    return true;
+}
+
+std::string MotorHotplug::base_path(udev_device *dev) const {
+    const char *devtype = udev_device_get_devtype(dev);
+    if (!devtype || std::string(devtype) != "usb_device") {
+        dev = udev_device_get_parent_with_subsystem_devtype(dev, "usb", "usb_device");
+    }
+    const char *syspath = dev ? udev_device_get_syspath(dev) : nullptr;
+    if (!syspath) {
+        return "";
+    }
+    return basename(const_cast<char *>(syspath));
+}
+
+bool MotorHotplug::is_motor(udev_device *dev) const {
+    if (user_space_driver_) {
+        const char *vendor = udev_device_get_sysattr_value(dev, "idVendor");
+        const char *product = udev_device_get_sysattr_value(dev, "idProduct");
+        return vendor && product && std::string(vendor) == "3293" && std::string(product) == "0100";
+    }
+    std::string sysname = udev_device_get_sysname(dev);
+    return sysname.find("usbrt") == 0 || sysname.find("mtr") == 0;
+}
+
+void MotorHotplug::scan() {
+    udev_enumerate *enumerate = udev_enumerate_new(udev_);
+    udev_enumerate_add_match_subsystem(enumerate, user_space_driver_ ? "usb" : "usbmisc");
+    udev_enumerate_scan_devices(enumerate);
+    udev_list_entry *entry;
+    udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(enumerate)) {
+        udev_device *dev = udev_device_new_from_syspath(udev_, udev_list_entry_get_name(entry));
+        if (dev) {
+            const char *devnode = udev_device_get_devnode(dev);
+            if (devnode && is_motor(dev)) {
+                index_[devnode] = base_path(dev);
+            }
+            udev_device_unref(dev);
+        }
+    }
+    udev_enumerate_unref(enumerate);
+}
+
+void MotorHotplug::receive_events() {
+    while (udev_device *dev = udev_monitor_receive_device(monitor_)) {
+        const char *action = udev_device_get_action(dev);
+        const char *devnode = udev_device_get_devnode(dev);
+        if (action && devnode) {
+            std::string a = action;
+            if (a == "remove") {
+                auto it = index_.find(devnode);
+                if (it != index_.end()) {
+                    for (int i=0; i<base_paths_.size(); i++) {
+                        if (base_paths_[i] == it->second) {
+                            removed_[i] = true;
+                        }
+                    }
+                    index_.erase(it);
+                }
+            } else if (a == "add" && is_motor(dev)) {
+                std::string path = base_path(dev);
+                index_[devnode] = path;
+                for (int i=0; i<base_paths_.size(); i++) {
+                    if (base_paths_[i] == path) {
+                        // try it right away
+                        next_attempt_[i] = std::chrono::steady_clock::now();
+                    }
+                }
+            }
+        }
+        udev_device_unref(dev);
+    }
+}
+
+// background thread handling of motor i while disconnected
+void MotorHotplug::check(int i) {
+    auto now = std::chrono::steady_clock::now();
+    if (!seen_disconnected_[i]) {
+        seen_disconnected_[i] = true;
+        std::cerr << "Motor " << base_paths_[i] << " disconnected" << std::endl;
+        // its remove event may not have arrived yet
+        next_attempt_[i] = removed_[i] ? now : now + kRetryTime;
+        return;
+    }
+    if (now < next_attempt_[i]) {
+        return;
+    }
+    next_attempt_[i] = now + kRetryTime;
+    if (!removed_[i]) {
+        // the device is still there, so try the same motor again
+        std::cerr << "Retrying motor " << base_paths_[i] << std::endl;
+        seen_disconnected_[i] = false;
+        state_[i].store(CONNECTED, std::memory_order_release);
+        return;
+    }
+    std::string devnode;
+    for (auto &d : index_) {
+        if (d.second == base_paths_[i]) {
+            devnode = d.first;
+        }
+    }
+    if (devnode.empty()) {
+        return;
+    }
+    try {
+        std::shared_ptr<Motor> motor;
+        if (user_space_driver_) {
+            motor = std::make_shared<UserSpaceMotor>(devnode);
+        } else {
+            motor = std::make_shared<Motor>(devnode);
+        }
+        if (motor->fd() < 0) {
+            throw std::runtime_error("Error opening " + devnode + ": " + strerror(errno));
+        }
+        auto motors = motors_;
+        motors[i] = motor;
+        std::shared_ptr<MotorIOUring> io_uring;
+        if (io_uring_) {
+            // registered fds and buffers belong to the old motor
+            io_uring = std::make_shared<MotorIOUring>(motors);
+        }
+        {
+            std::lock_guard<std::mutex> lock(motors_mutex_);
+            motors_ = motors;
+        }
+        swap_index_ = i;
+        swap_motor_ = motor;
+        swap_io_uring_ = io_uring;
+        removed_[i] = false;
+        seen_disconnected_[i] = false;
+        std::cerr << "Found motor " << base_paths_[i] << ": " << motor->name() << std::endl;
+        swap_state_.store(READY, std::memory_order_release);
+    } catch (std::runtime_error &e) {
+        std::cerr << "Reconnecting " << base_paths_[i] << ": " << e.what() << std::endl;
+    }
+}
+
+void MotorHotplug::run() {
+    while (!done_) {
+        pollfd fds[] = {{.fd = udev_monitor_get_fd(monitor_), .events = POLLIN},
+                        {.fd = event_fd_, .events = POLLIN}};
+        ::poll(fds, 2, 100);
+        if (fds[1].revents & POLLIN) {
+            uint64_t count;
+            ssize_t retval = ::read(event_fd_, &count, sizeof(count));
+            (void) retval;
+        }
+        receive_events();
+        if (swap_state_.load(std::memory_order_acquire) == TAKEN) {
+            // now the old ring, then the old motor, the ring waits for its
+            // transfers to finish
+            swap_io_uring_.reset();
+            swap_motor_.reset();
+            reconnects_.fetch_add(1, std::memory_order_relaxed);
+            swap_state_.store(EMPTY, std::memory_order_release);
+        }
+        for (int i=0; i<motors_.size(); i++) {
+            if (swap_state_.load(std::memory_order_acquire) != EMPTY) {
+                break;
+            }
+            if (!connected(i)) {
+                check(i);
+            } else {
+                seen_disconnected_[i] = false;
+            }
+        }
+    }
+}
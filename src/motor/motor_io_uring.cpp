@@ -0,0 +1,253 @@
+#include "motor_io_uring.h"
+#include "motor.h"
+
+#include <stdexcept>
+#include <typeinfo>
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+static int io_uring_setup(unsigned int entries, struct io_uring_params *p) {
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int ring_fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags) {
+    return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int io_uring_register(int ring_fd, unsigned int opcode, const void *arg, unsigned int nr_args) {
+    return syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+}
+
+enum { READ_OP, WRITE_OP };
+
+MotorIOUring::MotorIOUring(const std::vector<std::shared_ptr<Motor>> &motors)
+        : motors_(motors), handled_(motors.size()), read_result_(motors.size()), write_result_(motors.size()),
+          read_pending_(motors.size()), write_pending_(motors.size()) {
+    // one read and one write in flight per motor
+    struct io_uring_params p = {};
+    ring_fd_ = io_uring_setup(2*motors_.size() + 1, &p);
+    if (ring_fd_ < 0) {
+        throw std::runtime_error("io_uring setup error " + std::to_string(errno) + ": " + strerror(errno));
+    }
+
+    sq_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    cq_size_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+    }
+    sq_ptr_ = mmap(NULL, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        cq_ptr_ = sq_ptr_;
+    } else {
+        cq_ptr_ = mmap(NULL, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    }
+    sqes_size_ = p.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = mmap(NULL, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+    if (sq_ptr_ == MAP_FAILED || cq_ptr_ == MAP_FAILED || sqes == MAP_FAILED) {
+        ::close(ring_fd_);
+        throw std::runtime_error("io_uring mmap error " + std::to_string(errno) + ": " + strerror(errno));
+    }
+    sqes_ = reinterpret_cast<struct io_uring_sqe *>(sqes);
+
+    char *sq = reinterpret_cast<char *>(sq_ptr_);
+    sq_head_ = reinterpret_cast<unsigned int *>(sq + p.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned int *>(sq + p.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned int *>(sq + p.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned int *>(sq + p.sq_off.array);
+    char *cq = reinterpret_cast<char *>(cq_ptr_);
+    cq_head_ = reinterpret_cast<unsigned int *>(cq + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned int *>(cq + p.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned int *>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe *>(cq + p.cq_off.cqes);
+
+    // file index i is motor i, buffer 2*i is its status and 2*i+1 its command,
+    // other motor types get a placeholder that is never used
+    std::vector<int> fds(motors_.size(), -1);
+    std::vector<struct iovec> iovecs(2*motors_.size());
+    static char unused;
+    for (int i=0; i<motors_.size(); i++) {
+        Motor &m = *motors_[i];
+        handled_[i] = typeid(m) == typeid(Motor);
+        if (handled_[i]) {
+            fds[i] = m.fd_;
+            iovecs[2*i] = {&m.status_, sizeof(m.status_)};
+            iovecs[2*i+1] = {&m.command_, sizeof(m.command_)};
+        } else {
+            iovecs[2*i] = iovecs[2*i+1] = {&unused, sizeof(unused)};
+        }
+    }
+    if (io_uring_register(ring_fd_, IORING_REGISTER_FILES, fds.data(), fds.size()) < 0 ||
+            io_uring_register(ring_fd_, IORING_REGISTER_BUFFERS, iovecs.data(), iovecs.size()) < 0) {
+        int err = errno;
+        close();
+        throw std::runtime_error("io_uring register error " + std::to_string(err) + ": " + strerror(err));
+    }
+}
+
+MotorIOUring::~MotorIOUring() {
+    close();
+}
+
+void MotorIOUring::close() {
+    if (ring_fd_ < 0) {
+        return;
+    }
+    // buffers belong to the motors, so nothing can be left in flight
+    while (reads_in_flight_ || writes_in_flight_) {
+        if (io_uring_enter(ring_fd_, to_submit_, 1, IORING_ENTER_GETEVENTS) < 0) {
+            break;
+        }
+        to_submit_ = 0;
+        reap();
+    }
+    munmap(sqes_, sqes_size_);
+    if (cq_ptr_ != sq_ptr_) {
+        munmap(cq_ptr_, cq_size_);
+    }
+    munmap(sq_ptr_, sq_size_);
+    ::close(ring_fd_);
+    ring_fd_ = -1;
+}
+
+void MotorIOUring::queue(uint8_t opcode, int i) {
+    unsigned int tail = *sq_tail_;
+    unsigned int index = tail & *sq_mask_;
+    struct io_uring_sqe *sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->fd = i;
+    if (opcode == IORING_OP_READ_FIXED) {
+        sqe->addr = reinterpret_cast<uint64_t>(&motors_[i]->status_);
+        sqe->len = sizeof(motors_[i]->status_);
+        sqe->buf_index = 2*i;
+        sqe->user_data = 2*i + READ_OP;
+    } else {
+        sqe->addr = reinterpret_cast<uint64_t>(&motors_[i]->command_);
+        sqe->len = sizeof(motors_[i]->command_);
+        sqe->buf_index = 2*i + 1;
+        sqe->user_data = 2*i + WRITE_OP;
+    }
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    to_submit_++;
+}
+
+int MotorIOUring::enter(unsigned int min_complete) {
+    int retval;
+    do {
+        retval = io_uring_enter(ring_fd_, to_submit_, min_complete, min_complete ? IORING_ENTER_GETEVENTS : 0);
+    } while (retval < 0 && errno == EINTR);
+    if (retval < 0) {
+        // unsubmitted entries stay queued for the next enter, their motors
+        // read as pending in the meantime
+        return -1;
+    }
+    to_submit_ -= retval;
+    return 0;
+}
+
+void MotorIOUring::reap() {
+    unsigned int head = *cq_head_;
+    while (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &cqes_[head & *cq_mask_];
+        int i = cqe->user_data / 2;
+        if (cqe->user_data % 2 == READ_OP) {
+            read_result_[i] = cqe->res;
+            read_pending_[i] = false;
+            reads_in_flight_--;
+        } else {
+            write_result_[i] = cqe->res;
+            write_pending_[i] = false;
+            writes_in_flight_--;
+        }
+        head++;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+}
+
+void MotorIOUring::wait(const int &count, std::chrono::steady_clock::time_point deadline) {
+    reap();
+    while (count) {
+        if (deadline == std::chrono::steady_clock::time_point::max()) {
+            if (enter(count) < 0) {
+                reap();
+                break;
+            }
+        } else {
+            // the ring fd is readable when there are completions
+            auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if (remaining <= 0) {
+                break;
+            }
+            struct timespec ts = {remaining / 1000000000, remaining % 1000000000};
+            struct pollfd pfd = {ring_fd_, POLLIN};
+            if (::ppoll(&pfd, 1, &ts, NULL) == 0) {
+                reap();
+                break;
+            }
+        }
+        reap();
+    }
+}
+
+void MotorIOUring::submit_read() {
+    // a late read that has since finished is replaced by a new one
+    reap();
+    int queued = 0;
+    for (int i=0; i<motors_.size(); i++) {
+        if (handled_[i] && !read_pending_[i]) {
+            queue(IORING_OP_READ_FIXED, i);
+            read_pending_[i] = true;
+            reads_in_flight_++;
+            queued++;
+        }
+    }
+    if (queued) {
+        enter(0);
+    }
+}
+
+void MotorIOUring::read(std::chrono::steady_clock::time_point deadline) {
+    submit_read();
+    wait(reads_in_flight_, deadline);
+}
+
+void MotorIOUring::finish_write(std::chrono::steady_clock::time_point deadline) {
+    wait(writes_in_flight_, deadline);
+}
+
+void MotorIOUring::write() {
+    reap();
+    int queued = 0;
+    for (int i=0; i<motors_.size(); i++) {
+        if (handled_[i] && !write_pending_[i]) {
+            queue(IORING_OP_WRITE_FIXED, i);
+            write_pending_[i] = true;
+            writes_in_flight_++;
+            queued++;
+        }
+    }
+    if (queued) {
+        enter(0);
+    }
+}
+
+#else
+
+MotorIOUring::MotorIOUring(const std::vector<std::shared_ptr<Motor>> &motors) {
+    throw std::runtime_error("io_uring is not supported by this build");
+}
+MotorIOUring::~MotorIOUring() {}
+void MotorIOUring::close() {}
+void MotorIOUring::submit_read() {}
+void MotorIOUring::read(std::chrono::steady_clock::time_point deadline) {}
+void MotorIOUring::finish_write(std::chrono::steady_clock::time_point deadline) {}
+void MotorIOUring::write() {}
+
+#endif
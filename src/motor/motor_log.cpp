@@ -0,0 +1,391 @@
+#include "motor_log.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace motor_log {
+
+#define STATUS_FIELD(name, type, encoding) \
+    {#name, type, encoding, sizeof(Status::name), 0, offsetof(Status, name)}
+#define COMMAND_FIELD(name, type, encoding) \
+    {#name, type, encoding, sizeof(Command::name), 1, offsetof(Command, name)}
+
+// same column order as the csv, commands then statuses
+const std::vector<FieldInfo> &fields() {
+    static const std::vector<FieldInfo> f = {
+        COMMAND_FIELD(host_timestamp, UINT32, DELTA_VARINT),
+        COMMAND_FIELD(mode_desired, UINT8, RAW),
+        COMMAND_FIELD(current_desired, FLOAT, RAW),
+        COMMAND_FIELD(position_desired, FLOAT, RAW),
+        COMMAND_FIELD(velocity_desired, FLOAT, RAW),
+        COMMAND_FIELD(torque_desired, FLOAT, RAW),
+        COMMAND_FIELD(reserved, FLOAT, RAW),
+        STATUS_FIELD(mcu_timestamp, UINT32, DELTA_VARINT),
+        STATUS_FIELD(host_timestamp_received, UINT32, DELTA_VARINT),
+        STATUS_FIELD(motor_position, FLOAT, RAW),
+        STATUS_FIELD(joint_position, FLOAT, RAW),
+        STATUS_FIELD(iq, FLOAT, RAW),
+        STATUS_FIELD(torque, FLOAT, RAW),
+        STATUS_FIELD(motor_encoder, INT32, DELTA_VARINT),
+        {"reserved0", FLOAT, RAW, sizeof(float), 0, offsetof(Status, reserved)},
+        {"reserved1", FLOAT, RAW, sizeof(float), 0, offsetof(Status, reserved) + sizeof(float)},
+        {"reserved2", FLOAT, RAW, sizeof(float), 0, offsetof(Status, reserved) + 2*sizeof(float)},
+    };
+    return f;
+}
+
+static const uint32_t kTimeMaxSize = 10;
+
+static size_t page_round(size_t size) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    return (size + page - 1) / page * page;
+}
+
+static size_t type_size(uint8_t type) {
+    switch (type) {
+        case UINT8: return 1;
+        case UINT32: case INT32: case FLOAT: return 4;
+        case INT64: return 8;
+        default: return 0;
+    }
+}
+
+static size_t max_size(const FieldInfo &f) {
+    // a 32 bit zigzag varint is at most 5 bytes
+    return f.encoding == DELTA_VARINT ? 5 : f.size;
+}
+
+static uint32_t num_blocks(uint32_t num_motors) {
+    return 1 + fields().size() * num_motors;
+}
+
+static char *put_varint(char *p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = static_cast<char>(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = static_cast<char>(v);
+    return p;
+}
+
+static const char *get_varint(const char *p, const char *end, uint64_t *v) {
+    uint64_t value = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        value |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *v = value;
+            return p;
+        }
+    }
+    throw std::runtime_error("Motor log corrupt varint");
+}
+
+static uint64_t zigzag(int64_t d) {
+    return (static_cast<uint64_t>(d) << 1) ^ static_cast<uint64_t>(d >> 63);
+}
+
+static int64_t unzigzag(uint64_t z) {
+    return static_cast<int64_t>(z >> 1) ^ -static_cast<int64_t>(z & 1);
+}
+
+}  // namespace motor_log
+
+using namespace motor_log;
+
+MotorLogWriter::MotorLogWriter(std::string filename, std::vector<std::string> motor_names, uint32_t segment_records)
+        : filename_(filename), num_motors_(motor_names.size()), segment_records_(segment_records) {
+    if (segment_records_ == 0) {
+        throw std::runtime_error("Motor log segment_records must be positive");
+    }
+    fd_ = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) {
+        throw std::runtime_error("Motor log open error " + filename + ": " + std::strerror(errno));
+    }
+    const std::vector<FieldInfo> &f = fields();
+    size_t header_size = page_round(sizeof(FileHeader) + 32*num_motors_ + sizeof(FieldInfo)*f.size());
+    size_t record_size = kTimeMaxSize;
+    for (auto &field : f) {
+        record_size += max_size(field)*num_motors_;
+    }
+    size_t max_segment_size = page_round(sizeof(SegmentHeader) + sizeof(BlockInfo)*num_blocks(num_motors_) + record_size*segment_records_);
+    if (ftruncate(fd_, header_size)) {
+        ::close(fd_);
+        throw std::runtime_error("Motor log truncate error " + filename + ": " + std::strerror(errno));
+    }
+    void *p = mmap(nullptr, header_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (p == MAP_FAILED) {
+        ::close(fd_);
+        throw std::runtime_error("Motor log mmap error " + filename + ": " + std::strerror(errno));
+    }
+    header_ = static_cast<FileHeader *>(p);
+    std::memcpy(header_->magic, kMagic, sizeof(kMagic));
+    header_->version = kVersion;
+    header_->header_size = header_size;
+    header_->num_motors = num_motors_;
+    header_->num_fields = f.size();
+    header_->segment_records = segment_records_;
+    header_->max_segment_size = max_segment_size;
+    header_->page_size = sysconf(_SC_PAGESIZE);
+    header_->reserved = 0;
+    header_->num_segments = 0;
+    header_->num_records = 0;
+    offset_ = header_size;
+    char *names = reinterpret_cast<char *>(header_ + 1);
+    for (uint32_t i=0; i<num_motors_; i++) {
+        std::strncpy(names + 32*i, motor_names[i].c_str(), 31);
+    }
+    std::memcpy(names + 32*num_motors_, f.data(), sizeof(FieldInfo)*f.size());
+
+    times_.reserve(segment_records_);
+    statuses_.reserve(segment_records_*num_motors_);
+    commands_.reserve(segment_records_*num_motors_);
+}
+
+MotorLogWriter::~MotorLogWriter() {
+    try {
+        flush();
+    } catch (std::runtime_error &e) {}
+    // drop the preallocated space that was not used
+    if (ftruncate(fd_, offset_)) {}
+    munmap(header_, header_->header_size);
+    ::close(fd_);
+}
+
+void MotorLogWriter::write(int64_t time_ns, const Status *statuses, const Command *commands) {
+    times_.push_back(time_ns);
+    statuses_.insert(statuses_.end(), statuses, statuses + num_motors_);
+    commands_.insert(commands_.end(), commands, commands + num_motors_);
+    if (times_.size() >= segment_records_) {
+        flush();
+    }
+}
+
+void MotorLogWriter::grow() {
+    // preallocate several segments at a time so the file is not extended every flush
+    allocated_ = offset_ + 16*header_->max_segment_size;
+    int err = posix_fallocate(fd_, 0, allocated_);
+    if (err) {
+        throw std::runtime_error("Motor log allocate error " + filename_ + ": " + std::strerror(err));
+    }
+}
+
+void MotorLogWriter::flush() {
+    uint32_t n = times_.size();
+    if (n == 0) {
+        return;
+    }
+    size_t segment_size = header_->max_segment_size;
+    if (offset_ + segment_size > allocated_) {
+        grow();
+    }
+    void *p = mmap(nullptr, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, offset_);
+    if (p == MAP_FAILED) {
+        throw std::runtime_error("Motor log mmap error " + filename_ + ": " + std::strerror(errno));
+    }
+    char *segment = static_cast<char *>(p);
+    SegmentHeader *h = reinterpret_cast<SegmentHeader *>(segment);
+    h->magic = kSegmentMagic;
+    h->num_records = n;
+    h->first_record = header_->num_records;
+    h->first_time_ns = times_.front();
+    h->last_time_ns = times_.back();
+    BlockInfo *blocks = reinterpret_cast<BlockInfo *>(h + 1);
+    char *start = reinterpret_cast<char *>(blocks + num_blocks(num_motors_));
+    char *pos = start;
+
+    int64_t last_time = 0;
+    for (uint32_t i=0; i<n; i++) {
+        pos = put_varint(pos, zigzag(times_[i] - last_time));
+        last_time = times_[i];
+    }
+    blocks[0] = {static_cast<uint32_t>(start - segment), static_cast<uint32_t>(pos - start)};
+
+    int block = 1;
+    for (auto &f : fields()) {
+        const char *base = f.is_command ? reinterpret_cast<const char *>(commands_.data()) :
+                                          reinterpret_cast<const char *>(statuses_.data());
+        size_t stride = f.is_command ? sizeof(Command) : sizeof(Status);
+        for (uint32_t j=0; j<num_motors_; j++) {
+            start = pos;
+            const char *src = base + j*stride + f.offset;
+            if (f.encoding == DELTA_VARINT) {
+                uint32_t last = 0;
+                for (uint32_t i=0; i<n; i++, src += num_motors_*stride) {
+                    uint32_t v;
+                    std::memcpy(&v, src, sizeof(v));
+                    pos = put_varint(pos, zigzag(static_cast<int32_t>(v - last)));
+                    last = v;
+                }
+            } else {
+                for (uint32_t i=0; i<n; i++, src += num_motors_*stride) {
+                    std::memcpy(pos, src, f.size);
+                    pos += f.size;
+                }
+            }
+            blocks[block++] = {static_cast<uint32_t>(start - segment), static_cast<uint32_t>(pos - start)};
+        }
+    }
+    h->size = pos - segment;
+    munmap(p, segment_size);
+
+    offset_ += page_round(pos - segment);
+    header_->num_records += n;
+    header_->num_segments++;
+    times_.clear();
+    statuses_.clear();
+    commands_.clear();
+}
+
+MotorLogReader::MotorLogReader(std::string filename) {
+    fd_ = ::open(filename.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+        throw std::runtime_error("Motor log open error " + filename + ": " + std::strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd_, &st) || st.st_size < static_cast<off_t>(sizeof(FileHeader))) {
+        ::close(fd_);
+        throw std::runtime_error("Motor log too short " + filename);
+    }
+    size_ = st.st_size;
+    void *p = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+    if (p == MAP_FAILED) {
+        ::close(fd_);
+        throw std::runtime_error("Motor log mmap error " + filename + ": " + std::strerror(errno));
+    }
+    data_ = static_cast<const char *>(p);
+    header_ = reinterpret_cast<const FileHeader *>(data_);
+    if (std::memcmp(header_->magic, kMagic, sizeof(kMagic)) || header_->version != kVersion) {
+        munmap(p, size_);
+        ::close(fd_);
+        throw std::runtime_error("Not a motor log version " + std::to_string(kVersion) + ": " + filename);
+    }
+    // the motor names and field table must be inside the header
+    uint64_t tables_end = sizeof(FileHeader) + 32ull*header_->num_motors + sizeof(FieldInfo)*uint64_t(header_->num_fields);
+    if (tables_end > header_->header_size || header_->header_size > size_ || header_->page_size == 0) {
+        munmap(p, size_);
+        ::close(fd_);
+        throw std::runtime_error("Motor log header corrupt: " + filename);
+    }
+    const FieldInfo *f = reinterpret_cast<const FieldInfo *>(data_ + sizeof(FileHeader) + 32*header_->num_motors);
+    fields_.assign(f, f + header_->num_fields);
+    for (auto &field : fields_) {
+        if (field.offset + field.size > (field.is_command ? sizeof(Command) : sizeof(Status)) ||
+                field.size != type_size(field.type) || (field.encoding == DELTA_VARINT && field.size != 4)) {
+            munmap(p, size_);
+            ::close(fd_);
+            throw std::runtime_error("Motor log field " + std::string(field.name, strnlen(field.name, sizeof(field.name))) +
+                " does not match this build");
+        }
+    }
+    // walk the segment headers to index them, up to the first that is cut
+    // short or too small for its block table
+    uint64_t blocks_end = sizeof(SegmentHeader) + sizeof(BlockInfo)*(1 + uint64_t(fields_.size())*header_->num_motors);
+    size_t offset = header_->header_size;
+    for (uint64_t i=0; i<header_->num_segments && offset + sizeof(SegmentHeader) <= size_; i++) {
+        const SegmentHeader *h = reinterpret_cast<const SegmentHeader *>(data_ + offset);
+        if (h->magic != kSegmentMagic || offset + h->size > size_ || h->size < blocks_end) {
+            break;
+        }
+        segments_.push_back(h);
+        offset += (h->size + header_->page_size - 1) / header_->page_size * header_->page_size;
+    }
+}
+
+MotorLogReader::~MotorLogReader() {
+    munmap(const_cast<char *>(data_), size_);
+    ::close(fd_);
+}
+
+std::vector<std::string> MotorLogReader::motor_names() const {
+    std::vector<std::string> names;
+    const char *p = data_ + sizeof(FileHeader);
+    for (uint32_t i=0; i<num_motors(); i++) {
+        names.push_back(std::string(p + 32*i, strnlen(p + 32*i, 32)));
+    }
+    return names;
+}
+
+const SegmentHeader *MotorLogReader::segment(uint64_t i) const {
+    if (i >= num_segments()) {
+        throw std::runtime_error("Motor log segment " + std::to_string(i) + " out of range");
+    }
+    return segments_[i];
+}
+
+uint64_t MotorLogReader::find_segment(int64_t time_ns) const {
+    uint64_t lo = 0, hi = num_segments();
+    while (lo < hi) {
+        uint64_t mid = (lo + hi) / 2;
+        if (segment(mid)->last_time_ns < time_ns) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+void MotorLogReader::read_segment(uint64_t i, std::vector<int64_t> *times,
+        std::vector<Status> *statuses, std::vector<Command> *commands) const {
+    const SegmentHeader *h = segment(i);
+    const char *segment = reinterpret_cast<const char *>(h);
+    const BlockInfo *blocks = reinterpret_cast<const BlockInfo *>(h + 1);
+    uint32_t n = h->num_records;
+    uint32_t num_motors = header_->num_motors;
+    times->resize(n);
+    statuses->assign(n*num_motors, Status());
+    commands->assign(n*num_motors, Command());
+
+    auto block = [&](int b, const char **end) {
+        if (uint64_t(blocks[b].offset) + blocks[b].size > h->size) {
+            throw std::runtime_error("Motor log segment " + std::to_string(i) + " corrupt");
+        }
+        const char *p = segment + blocks[b].offset;
+        *end = p + blocks[b].size;
+        return p;
+    };
+    const char *end;
+    const char *p = block(0, &end);
+    int64_t time = 0;
+    for (uint32_t k=0; k<n; k++) {
+        uint64_t z;
+        p = get_varint(p, end, &z);
+        time += unzigzag(z);
+        (*times)[k] = time;
+    }
+
+    int b = 1;
+    for (auto &f : fields_) {
+        char *base = f.is_command ? reinterpret_cast<char *>(commands->data()) :
+                                    reinterpret_cast<char *>(statuses->data());
+        size_t stride = f.is_command ? sizeof(Command) : sizeof(Status);
+        for (uint32_t j=0; j<num_motors; j++) {
+            p = block(b++, &end);
+            char *dst = base + j*stride + f.offset;
+            if (f.encoding == DELTA_VARINT) {
+                uint32_t v = 0;
+                for (uint32_t k=0; k<n; k++, dst += num_motors*stride) {
+                    uint64_t z;
+                    p = get_varint(p, end, &z);
+                    v += static_cast<uint32_t>(unzigzag(z));
+                    std::memcpy(dst, &v, sizeof(v));
+                }
+            } else {
+                if (uint64_t(n)*f.size > static_cast<uint64_t>(end - p)) {
+                    throw std::runtime_error("Motor log segment " + std::to_string(i) + " corrupt");
+                }
+                for (uint32_t k=0; k<n; k++, dst += num_motors*stride) {
+                    std::memcpy(dst, p, f.size);
+                    p += f.size;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,93 @@
+#include "CLI11.hpp"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "motor_log.h"
+#include "motor_format.h"
+
+// one value as the MotorFormatter Status and Command rows print it
+static void append_field(MotorFormatter &format, const motor_log::FieldInfo &f, const char *p, bool reserved_u32) {
+    // reserved1 and reserved2 of Status are uint32 with -u
+    bool as_uint32 = reserved_u32 && !f.is_command && f.type == motor_log::FLOAT &&
+        (!std::strncmp(f.name, "reserved1", sizeof(f.name)) || !std::strncmp(f.name, "reserved2", sizeof(f.name)));
+    switch (as_uint32 ? motor_log::UINT32 : f.type) {
+        case motor_log::UINT8: { uint8_t v; std::memcpy(&v, p, sizeof(v)); format.append(static_cast<uint32_t>(v)); break; }
+        case motor_log::UINT32: { uint32_t v; std::memcpy(&v, p, sizeof(v)); format.append(v); break; }
+        case motor_log::INT32: { int32_t v; std::memcpy(&v, p, sizeof(v)); format.append(v); break; }
+        case motor_log::INT64: { int64_t v; std::memcpy(&v, p, sizeof(v)); format.append(v); break; }
+        case motor_log::FLOAT: { float v; std::memcpy(&v, p, sizeof(v)); format.append(static_cast<double>(v)); break; }
+    }
+}
+
+// Convert a binary motor log to the same csv layout as MotorApp's data.csv
+int main(int argc, char **argv) {
+    CLI::App app{"Export a binary motor log to csv"};
+    std::string input, output;
+    double start_s = 0, duration_s = 0;
+    bool reserved_u32 = false;
+    app.add_option("input", input, "Binary motor log")->required();
+    app.add_option("-o,--output", output, "Csv file, default stdout");
+    app.add_option("--start", start_s, "Start time (s) relative to the first record");
+    app.add_option("--duration", duration_s, "Duration (s) to export, default to the end");
+    app.add_flag("-u,--reserved-uint32", reserved_u32, "Interpret reserved 1 & 2 as uint32 rather than floats");
+    CLI11_PARSE(app, argc, argv);
+
+    try {
+        MotorLogReader log(input);
+        std::ofstream file;
+        if (output.size()) {
+            file.open(output);
+        }
+        std::ostream &os = output.size() ? file : std::cout;
+        MotorFormatter format;
+
+        // columns are the fields of the file, which the rows follow
+        const std::vector<motor_log::FieldInfo> &fields = log.fields();
+        os << "timestamp, ";
+        for (auto &f : fields) {
+            for (uint32_t i=0; i<log.num_motors(); i++) {
+                os << std::string(f.name, strnlen(f.name, sizeof(f.name))) << i << ", ";
+            }
+        }
+        os << '\n';
+        if (log.num_segments() == 0) {
+            return 0;
+        }
+
+        std::vector<int64_t> times;
+        std::vector<Status> statuses;
+        std::vector<Command> commands;
+        log.read_segment(0, &times, &statuses, &commands);
+        int64_t t0 = times[0];
+        int64_t start = t0 + start_s*1e9;
+        int64_t end = duration_s > 0 ? start + duration_s*1e9 : INT64_MAX;
+        uint32_t n = log.num_motors();
+        for (uint64_t i=log.find_segment(start); i<log.num_segments(); i++) {
+            log.read_segment(i, &times, &statuses, &commands);
+            if (times.front() > end) {
+                break;
+            }
+            for (size_t j=0; j<times.size(); j++) {
+                if (times[j] < start || times[j] > end) {
+                    continue;
+                }
+                format.append(times[j]).append(", ");
+                for (auto &f : fields) {
+                    for (uint32_t k=0; k<n; k++) {
+                        const char *src = f.is_command ? reinterpret_cast<const char *>(&commands[j*n + k]) :
+                                                         reinterpret_cast<const char *>(&statuses[j*n + k]);
+                        append_field(format, f, src + f.offset, reserved_u32);
+                        format.append(", ");
+                    }
+                }
+                format.append('\n');
+            }
+            os.write(format.data(), format.size());
+            format.clear();
+        }
+    } catch (std::runtime_error &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
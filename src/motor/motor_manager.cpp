@@ -1,17 +1,29 @@
 #include "motor_manager.h"
 #include "motor.h"
+#include "motor_io_uring.h"
+#include "motor_hotplug.h"
 
 #include <libudev.h>
 
+#include <cmath>
 #include <cstring>
 #include <algorithm>
 #include <poll.h>
+#include <exception>
 #include <sstream>
+#include <thread>
+#include <unordered_map>
 
-// Returns a vector of strings that contain the dev file locations,
-// e.g. /dev/skel0
-static std::vector<std::string> udev (bool user_space_driver=false)
-{
+static std::string sysattr(struct udev_device *dev, const char *name) {
+    const char *value = dev ? udev_device_get_sysattr_value(dev, name) : NULL;
+    return value ? value : "";
+}
+
+// Returns the motor devices, e.g. /dev/skel0, with their identity read from
+// udev without opening them. The name is the one sysfs read that is not part
+// of the enumeration, so it is cached for as long as the device stays
+// enumerated with the same serial number and version.
+std::vector<MotorManager::DeviceInfo> MotorManager::udev() {
 	struct udev_enumerate *enumerate;
 	struct udev_list_entry *devices, *dev_list_entry;
     
@@ -24,7 +36,7 @@ static std::vector<std::string> udev (bool user_space_driver=false)
 	
 	/* Create a list of the devices in the 'hidraw' subsystem. */
 	enumerate = udev_enumerate_new(udev);
-    if (user_space_driver) {
+    if (user_space_driver_) {
         udev_enumerate_add_match_sysattr(enumerate, "idVendor", "3293");
         udev_enumerate_add_match_sysattr(enumerate, "idProduct", "0100");
     } else {
@@ -35,20 +47,38 @@ static std::vector<std::string> udev (bool user_space_driver=false)
 	udev_enumerate_scan_devices(enumerate);
 	devices = udev_enumerate_get_list_entry(enumerate);
 
-    std::vector<std::string> dev_paths;
+    std::vector<DeviceInfo> dev_infos;
+    std::map<std::string, DeviceInfo> identity_cache;
 	udev_list_entry_foreach(dev_list_entry, devices) {
 		// path in /sys/devices/pci*
 		const char *path = udev_list_entry_get_name(dev_list_entry);
 		struct udev_device *dev = udev_device_new_from_syspath(udev, path);
-        const char * sysname = udev_device_get_sysname(dev);
-        const char * subsystem = udev_device_get_subsystem(dev);
-        const char * devpath = udev_device_get_devpath(dev);
 
         // TODO better way of identifying other than interface number 0
 		//if (std::string("00") == udev_device_get_sysattr_value(dev, "device/bInterfaceNumber")) {
-			devpath = udev_device_get_devnode(dev);
-            if (devpath) {
-                dev_paths.push_back(devpath);
+			const char *devnode = udev_device_get_devnode(dev);
+            if (devnode) {
+                struct udev_device *usb = user_space_driver_ ? dev :
+                    udev_device_get_parent_with_subsystem_devtype(dev, "usb", "usb_device");
+                DeviceInfo info;
+                info.dev_path = devnode;
+                info.serial_number = sysattr(usb, "serial");
+                info.version = sysattr(usb, "configuration");
+                // devnum changes every time the device enumerates
+                info.devnum = sysattr(usb, "devnum");
+                const char *syspath = usb ? udev_device_get_syspath(usb) : NULL;
+                info.base_path = syspath ? basename(const_cast<char *>(syspath)) : "";
+                auto cached = identity_cache_.find(info.dev_path);
+                if (cached != identity_cache_.end() && cached->second.serial_number == info.serial_number &&
+                        cached->second.version == info.version && cached->second.devnum == info.devnum) {
+                    info.name = cached->second.name;
+                } else if (user_space_driver_) {
+                    info.name = sysattr(dev, (std::string(udev_device_get_sysname(dev)) + ":1.0/interface").c_str());
+                } else {
+                    info.name = sysattr(dev, "device/interface");
+                }
+                identity_cache[info.dev_path] = info;
+                dev_infos.push_back(info);
             }
 		//}
 		
@@ -60,42 +90,100 @@ static std::vector<std::string> udev (bool user_space_driver=false)
 
 	udev_unref(udev);
 
-	return dev_paths;       
+    identity_cache_ = identity_cache;
+	return dev_infos;       
+}
+
+// Construct motors for devices in parallel. Each constructor does its own
+// udev lookups and opens the device and its text api. A device that already
+// has a Motor in use gets that Motor rather than being opened twice.
+std::vector<std::shared_ptr<Motor>> MotorManager::open_motors(const std::vector<DeviceInfo> &devices) {
+    std::vector<std::shared_ptr<Motor>> m(devices.size());
+    std::vector<std::thread> probes;
+    // a device listed more than once is opened once and shared, as opening
+    // it twice at once fails, e.g. on the usb interface claim
+    std::unordered_map<std::string, int> first;
+    std::vector<int> same(devices.size(), -1);
+    for (int i=0; i<devices.size(); i++) {
+        if (devices[i].dev_path.size()) {
+            auto f = first.emplace(devices[i].dev_path, i);
+            if (!f.second) {
+                same[i] = f.first->second;
+                continue;
+            }
+        }
+        auto open = open_motors_.find(devices[i].dev_path + ":" + devices[i].devnum);
+        if (open != open_motors_.end()) {
+            m[i] = open->second.lock();
+        }
+        if (!m[i] && devices[i].dev_path.size()) {
+            probes.emplace_back([this, &devices, &m, i] {
+                try {
+                    if (user_space_driver_ == true) {
+                        m[i] = std::make_shared<UserSpaceMotor>(devices[i].dev_path);
+                    } else {
+                        m[i] = std::make_shared<Motor>(devices[i].dev_path);
+                    }
+                } catch (std::runtime_error &e) {
+                    // There is a runtime_error if the motor is disconnected during this function
+                }
+            });
+        }
+    }
+    for (auto &probe : probes) {
+        probe.join();
+    }
+    for (int i=0; i<devices.size(); i++) {
+        if (same[i] >= 0) {
+            m[i] = m[same[i]];
+        }
+    }
+    for (auto it = open_motors_.begin(); it != open_motors_.end(); ) {
+        it = it->second.expired() ? open_motors_.erase(it) : std::next(it);
+    }
+    std::vector<std::shared_ptr<Motor>> found;
+    for (int i=0; i<devices.size(); i++) {
+        if (m[i]) {
+            open_motors_[devices[i].dev_path + ":" + devices[i].devnum] = m[i];
+        }
+        found.push_back(m[i]);
+    }
+    return found;
 }
 
 std::vector<std::shared_ptr<Motor>> MotorManager::get_connected_motors(bool connect) {
-    auto dev_paths = udev(user_space_driver_);
+    auto devices = open_motors(udev());
     std::vector<std::shared_ptr<Motor>> m;
-    for (auto dev_path : dev_paths) {
-        try {
-            if (user_space_driver_ == true) {
-                m.push_back(std::make_shared<UserSpaceMotor>(dev_path));
-            } else {
-                m.push_back(std::make_shared<Motor>(dev_path));
-            }
-        } catch (std::runtime_error &e) {
-            // There is a runtime_error if the motor is disconnected during this function
+    for (auto &motor : devices) {
+        if (motor) {
+            m.push_back(motor);
         }
     }
     if (connect) {
-        motors_ = m;
-        commands_.resize(m.size());
+        set_motors(m);
     }
     return m;
 }
 
-std::vector<std::shared_ptr<Motor>> MotorManager::get_motors_by_name_function(std::vector<std::string> names, std::string (Motor::*name_fun)() const, bool connect, bool allow_simulated) {
-    auto connected_motors = get_connected_motors(connect);
-    std::vector<std::shared_ptr<Motor>> m(names.size());
+std::vector<std::shared_ptr<Motor>> MotorManager::get_motors_by_name_function(std::vector<std::string> names, std::string DeviceInfo::*field, bool connect, bool allow_simulated) {
+    // only the matching devices are opened
+    auto devices = udev();
+    std::unordered_map<std::string, std::vector<size_t>> index;
+    for (size_t i=0; i<devices.size(); i++) {
+        index[devices[i].*field].push_back(i);
+    }
+    std::vector<DeviceInfo> matches;
     for (int i=0; i<names.size(); i++) {
-        std::vector<std::shared_ptr<Motor>> found_motors;
-        std::copy_if(connected_motors.begin(), connected_motors.end(), std::back_inserter(found_motors), [&names, &i, &name_fun](std::shared_ptr<Motor> m){ return names[i] == (m.get()->*name_fun)(); });
-        if (found_motors.size() == 1) {
-            m[i] = found_motors[0];
-        } else {
-            if (found_motors.size() > 1) {
-                throw std::runtime_error("Found too many motors matching: " + names[i]);
-            }
+        auto found_motors = index.find(names[i]);
+        size_t found = found_motors == index.end() ? 0 : found_motors->second.size();
+        if (found > 1) {
+            throw std::runtime_error("Found too many motors matching: " + names[i]);
+        }
+        matches.push_back(found ? devices[found_motors->second[0]] : DeviceInfo());
+    }
+    auto m = open_motors(matches);
+    for (int i=0; i<names.size(); i++) {
+        if (!m[i]) {
             if (allow_simulated) {
                 std::cout << "Warning: found no motors matching \"" << names[i] << "\", using simulated motor" << std::endl;
                 m[i] = std::make_shared<SimulatedMotor>(names[i]);
@@ -105,82 +193,437 @@ std::vector<std::shared_ptr<Motor>> MotorManager::get_motors_by_name_function(st
         }
     }
     if (connect) {
-        motors_ = m;
-        commands_.resize(m.size());
+        set_motors(m);
     }
     return m;
 }
 
 std::vector<std::shared_ptr<Motor>> MotorManager::get_motors_by_name(std::vector<std::string> names, bool connect, bool allow_simulated) {
-    return get_motors_by_name_function(names, &Motor::name, connect, allow_simulated);
+    return get_motors_by_name_function(names, &DeviceInfo::name, connect, allow_simulated);
 }
 
 std::vector<std::shared_ptr<Motor>> MotorManager::get_motors_by_serial_number(std::vector<std::string> serial_numbers, bool connect, bool allow_simulated) {
-    return get_motors_by_name_function(serial_numbers, &Motor::serial_number, connect, allow_simulated);
+    return get_motors_by_name_function(serial_numbers, &DeviceInfo::serial_number, connect, allow_simulated);
 }
 
 std::vector<std::shared_ptr<Motor>> MotorManager::get_motors_by_path(std::vector<std::string> paths, bool connect, bool allow_simulated) {
-    return get_motors_by_name_function(paths, &Motor::base_path, connect, allow_simulated);
+    return get_motors_by_name_function(paths, &DeviceInfo::base_path, connect, allow_simulated);
 }
 
 std::vector<std::shared_ptr<Motor>> MotorManager::get_motors_by_devpath(std::vector<std::string> devpaths, bool connect, bool allow_simulated) {
-    return get_motors_by_name_function(devpaths, &Motor::dev_path, connect, allow_simulated);
+    return get_motors_by_name_function(devpaths, &DeviceInfo::dev_path, connect, allow_simulated);
+}
+
+void MotorManager::set_motors(std::vector<std::shared_ptr<Motor>> motors) {
+    hotplug_.reset();
+    io_uring_.reset();
+    motors_ = motors;
+    commands_.resize(motors_.size());
+    statuses_.resize(motors_.size());
+    stale_.assign(motors_.size(), false);
+    std::vector<MotorErrors>(motors_.size()).swap(errors_);
+    pollfds_.resize(motors_.size());
+    if (io_uring_enabled_) {
+        io_uring_ = std::make_shared<MotorIOUring>(motors_);
+    }
+    if (reconnect_) {
+        hotplug_ = std::make_shared<MotorHotplug>(motors_, user_space_driver_, io_uring_enabled_);
+    }
+}
+
+void MotorManager::set_reconnect(bool reconnect) {
+    reconnect_ = reconnect;
+    if (!reconnect_) {
+        hotplug_.reset();
+    } else if (!hotplug_) {
+        hotplug_ = std::make_shared<MotorHotplug>(motors_, user_space_driver_, io_uring_enabled_);
+    }
+}
+
+bool MotorManager::connected(int i) const {
+    return !hotplug_ || hotplug_->connected(i);
+}
+
+uint64_t MotorManager::reconnects() const {
+    return hotplug_ ? hotplug_->reconnects() : 0;
 }
 
-std::vector<Status> MotorManager::read() {
-    std::vector<Status> statuses(motors_.size());
+void MotorManager::set_io_uring(bool io_uring) {
+    io_uring_enabled_ = io_uring;
+    set_motors(motors_);
+}
+
+const std::vector<Status> &MotorManager::read() {
+    read(statuses_.data());
+    return statuses_;
+}
+
+void MotorManager::take_replacement() {
+    // between transfers is the only time the ring can be replaced
+    if (hotplug_ && (!io_uring_ || io_uring_->idle())) {
+        hotplug_->take(motors_, io_uring_);
+    }
+}
+
+std::chrono::steady_clock::time_point MotorManager::io_deadline() const {
+    if (io_budget_.count() == 0) {
+        return std::chrono::steady_clock::time_point::max();
+    }
+    return std::chrono::steady_clock::now() + io_budget_;
+}
+
+// count a failed transfer, with reconnect the hotplug thread takes over
+void MotorManager::io_error(int i, int err) {
+    errors_[i].error(err);
+    if (hotplug_) {
+        hotplug_->disconnected(i);
+    }
+}
+
+void MotorManager::read(Status *statuses) {
+    take_replacement();
+    if (!aread_started_) {
+        read_deadline_ = io_deadline();
+    }
+    aread_started_ = false;
+    // start every transfer before waiting on any of them
     for (int i=0; i<motors_.size(); i++) {
-        auto size = motors_[i]->read();
-        if (size == -1) {
-            // no data, error is in errno
-            std::string err = "No data read from: " + motors_[i]->name() + ": " + std::to_string(errno) + ": " + strerror(errno);
-            if (!reconnect_) {
-                throw std::runtime_error(err);
+        stale_[i] = !connected(i);
+        if (!stale_[i] && motors_[i]->submit_read() < 0) {
+            io_error(i, errno);
+            stale_[i] = true;
+        }
+    }
+    if (io_uring_) {
+        io_uring_->read(read_deadline_);
+    }
+    bool timed = io_budget_.count() != 0;
+    for (int i=0; i<motors_.size(); i++) {
+        if (stale_[i]) {
+            // last status until it is reconnected
+            continue;
+        }
+        stale_[i] = true;
+        ssize_t size;
+        if (io_uring_ && io_uring_->handles(i)) {
+            if (io_uring_->read_pending(i)) {
+                size = -1;
+                errno = ETIMEDOUT;
             } else {
-                if (reconnect_rate_.run()) {
-                    std::cerr << err << std::endl;
-                    std::cerr << "trying to reconnect " << motors_[i]->base_path() << std::endl;
-                    try {
-                        auto motors = get_motors_by_path({motors_[i]->base_path()}, false);
-                        if (motors[0]) {
-                            std::cerr << "found motor " << motors_[i]->base_path() << ": " << motors[0]->name() << std::endl;
-                            motors_[i] = motors[0];
-                        }
-                    } catch (std::runtime_error &e) {
-                        std::cerr << e.what() << std::endl;
-                    }
+                size = io_uring_->result(i);
+                if (size < 0) {
+                    errno = -size;
+                    size = -1;
                 }
             }
+        } else {
+            size = timed ? motors_[i]->timed_read(read_deadline_) : motors_[i]->read();
+        }
+        if (size == -1) {
+            if (timed && errno == ETIMEDOUT) {
+                // late rather than gone, keep the last status
+                errors_[i].late_read();
+            } else {
+                io_error(i, errno);
+            }
+            continue;
+        }
+        if (static_cast<size_t>(size) < sizeof(Status)) {
+            errors_[i].short_read();
+            if (size == 0) {
+                continue;
+            }
         }
         statuses[i] = *motors_[i]->status();
+        stale_[i] = false;
     }
-    return statuses;
 }
 
-void MotorManager::write(std::vector<Command> commands) {
+void MotorManager::write(const std::vector<Command> &commands) {
+    auto deadline = io_deadline();
+    bool timed = io_budget_.count() != 0;
+    if (io_uring_) {
+        // commands are registered buffers, the last writes must finish first
+        io_uring_->finish_write(deadline);
+        for (int i=0; i<motors_.size(); i++) {
+            if (io_uring_->handles(i) && !io_uring_->write_pending(i) && connected(i)) {
+                ssize_t res = io_uring_->write_result(i);
+                if (res < 0) {
+                    io_error(i, -res);
+                }
+            }
+        }
+    }
+    take_replacement();
     count_++;
     if (auto_count_) {
         set_command_count(count_);
-        for (int i=0; i<commands.size(); i++) {
-            commands[i].host_timestamp = count_;
-        }
     }
     for (int i=0; i<motors_.size(); i++) {
+        if (io_uring_ && io_uring_->handles(i) && io_uring_->write_pending(i)) {
+            // its buffer still belongs to the last write, skip this command
+            errors_[i].late_write();
+            continue;
+        }
         *motors_[i]->command() = commands[i];
-        motors_[i]->write();
+        if (auto_count_) {
+            motors_[i]->command()->host_timestamp = count_;
+        }
+        if ((!io_uring_ || !io_uring_->handles(i)) && connected(i)) {
+            ssize_t size = timed ? motors_[i]->timed_write(deadline) : motors_[i]->write();
+            if (size == -1) {
+                if (timed && errno == ETIMEDOUT) {
+                    errors_[i].late_write();
+                } else {
+                    io_error(i, errno);
+                }
+            }
+        }
+    }
+    if (io_uring_) {
+        io_uring_->write();
     }
 }
 
 void MotorManager::aread() {
+    take_replacement();
+    read_deadline_ = io_deadline();
+    aread_started_ = true;
+    if (io_uring_) {
+        io_uring_->submit_read();
+    }
     for (int i=0; i<motors_.size(); i++) {
-        motors_[i]->aread();
+        if ((!io_uring_ || !io_uring_->handles(i)) && connected(i)) {
+            if (motors_[i]->aread() < 0) {
+                io_error(i, errno);
+            }
+        }
     }
 }
 
-void MotorManager::set_commands(std::vector<Command> commands) {
-    for (int i=0; i<commands_.size(); i++) {
-        commands_[i] = commands[i];
+std::vector<MotorErrorCounts> MotorManager::errors() const {
+    std::vector<MotorErrorCounts> counts;
+    for (auto &e : errors_) {
+        counts.push_back(e.counts());
+    }
+    return counts;
+}
+
+std::vector<std::vector<TextAPIValue>> MotorManager::run_text(const std::vector<TextAPIBatch> &batches,
+        std::vector<std::chrono::nanoseconds> *times, std::vector<std::string> *errors_out) {
+    if (batches.size() > motors_.size()) {
+        throw std::runtime_error("More text api batches than motors");
+    }
+    std::vector<std::vector<TextAPIValue>> values(batches.size());
+    std::vector<std::exception_ptr> errors(batches.size());
+    std::vector<std::chrono::nanoseconds> t(batches.size());
+    std::vector<std::thread> threads;
+    for (int i=0; i<batches.size(); i++) {
+        threads.emplace_back([&batches, &values, &errors, &t, i] {
+            auto start = std::chrono::steady_clock::now();
+            try {
+                values[i] = batches[i].run();
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+            t[i] = std::chrono::steady_clock::now() - start;
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    if (times) {
+        *times = t;
+    }
+    if (errors_out) {
+        errors_out->assign(batches.size(), "");
+    }
+    for (int i=0; i<errors.size(); i++) {
+        if (!errors[i]) {
+            continue;
+        }
+        if (!errors_out) {
+            std::rethrow_exception(errors[i]);
+        }
+        try {
+            std::rethrow_exception(errors[i]);
+        } catch (std::exception &e) {
+            (*errors_out)[i] = e.what();
+        } catch (...) {
+            (*errors_out)[i] = "unknown error";
+        }
+    }
+    return values;
+}
+
+std::vector<std::vector<TextAPIValue>> MotorManager::get_text(const std::vector<std::string> &names) {
+    std::vector<TextAPIBatch> batches;
+    for (auto &motor : motors_) {
+        batches.push_back(motor->text_batch());
+        for (auto &name : names) {
+            batches.back().get(name);
+        }
+    }
+    return run_text(batches);
+}
+
+std::vector<MotorParameterSet> MotorManager::snapshot_parameters(const std::vector<std::string> &names,
+        std::vector<MotorParameterReport> *reports) {
+    std::vector<std::chrono::nanoseconds> times;
+    std::vector<TextAPIBatch> batches;
+    for (auto &motor : motors_) {
+        batches.push_back(motor->text_batch());
+        for (auto &name : names) {
+            batches.back().get(name);
+        }
+    }
+    std::vector<std::string> errors;
+    auto values = run_text(batches, &times, &errors);
+    std::vector<MotorParameterSet> sets(motors_.size());
+    std::vector<MotorParameterReport> r(motors_.size());
+    for (int i=0; i<motors_.size(); i++) {
+        sets[i].name = r[i].name = motors_[i]->name();
+        sets[i].serial_number = motors_[i]->serial_number();
+        sets[i].version = motors_[i]->version();
+        r[i].time = times[i];
+        r[i].parameters = values[i].size();
+        if (errors[i].size()) {
+            r[i].errors.push_back(errors[i]);
+        }
+        for (auto &v : values[i]) {
+            sets[i].values.push_back({v.name, v.str});
+            if (v.str.empty()) {
+                r[i].errors.push_back(v.name + ": no reply");
+            }
+        }
+    }
+    if (reports) {
+        *reports = r;
+    }
+    return sets;
+}
+
+// read back values are the firmware's formatting of what was written
+static bool same_value(const TextAPIValue &written, const TextAPIValue &read) {
+    if (written.str == read.str) {
+        return true;
+    }
+    if (written.is_number() && read.is_number()) {
+        double a = written.as_double(), b = read.as_double();
+        return std::fabs(a - b) <= 1e-6 * std::max(1.0, std::max(std::fabs(a), std::fabs(b)));
     }
+    return false;
+}
+
+std::vector<MotorParameterReport> MotorManager::restore_parameters(const std::vector<MotorParameterSet> &sets, bool verify) {
+    std::vector<MotorParameterReport> reports;
+    std::vector<const MotorParameterSet *> motor_sets(motors_.size());
+    for (auto &set : sets) {
+        int match = -1;
+        bool duplicate = false;
+        for (int i=0; i<motors_.size() && match < 0; i++) {
+            if (set.serial_number.size() && set.serial_number == motors_[i]->serial_number()) {
+                match = i;
+                duplicate = motor_sets[i] != nullptr;
+            }
+        }
+        for (int i=0; i<motors_.size() && match < 0; i++) {
+            if (set.name == motors_[i]->name() && !motor_sets[i]) {
+                match = i;
+            }
+        }
+        if (match < 0 || duplicate) {
+            MotorParameterReport report;
+            report.name = set.name;
+            if (duplicate) {
+                report.errors.push_back("another set is also for serial number " + set.serial_number + ", not restored");
+            } else {
+                report.errors.push_back("no motor with serial number " + set.serial_number + " or name " + set.name);
+            }
+            reports.push_back(report);
+        } else {
+            motor_sets[match] = &set;
+        }
+    }
+
+    // values[written[i][j]] of motor i's set are written, the rest are too
+    // long for a text api request and only reported
+    std::vector<TextAPIBatch> batches;
+    std::vector<std::vector<size_t>> written(motors_.size());
+    for (int i=0; i<motors_.size(); i++) {
+        batches.push_back(motors_[i]->text_batch());
+        if (motor_sets[i]) {
+            auto &values = motor_sets[i]->values;
+            for (size_t j=0; j<values.size(); j++) {
+                if (values[j].first.size() + 1 + values[j].second.size() <= TextFile::kMaxLength) {
+                    written[i].push_back(j);
+                    batches.back().set(values[j].first, values[j].second);
+                }
+            }
+            if (verify) {
+                for (size_t j : written[i]) {
+                    batches.back().get(values[j].first);
+                }
+            }
+        }
+    }
+    std::vector<std::chrono::nanoseconds> times;
+    std::vector<std::string> errors;
+    auto values = run_text(batches, &times, &errors);
+    for (int i=0; i<motors_.size(); i++) {
+        if (!motor_sets[i]) {
+            continue;
+        }
+        auto &set = *motor_sets[i];
+        MotorParameterReport report;
+        report.name = motors_[i]->name();
+        report.time = times[i];
+        report.parameters = set.values.size();
+        if (set.version.size() && set.version != motors_[i]->version()) {
+            report.errors.push_back("saved from firmware " + set.version + ", now " + motors_[i]->version());
+        }
+        for (size_t j=0, k=0; j<set.values.size(); j++) {
+            if (k < written[i].size() && written[i][k] == j) {
+                k++;
+            } else {
+                report.errors.push_back(set.values[j].first + ": longer than " +
+                    std::to_string(TextFile::kMaxLength) + " bytes with its value, not written");
+            }
+        }
+        if (errors[i].size()) {
+            // nothing is known about which values were written
+            report.errors.push_back(errors[i]);
+            reports.push_back(report);
+            continue;
+        }
+        size_t n = written[i].size();
+        for (size_t k=0; k<n; k++) {
+            const TextAPIValue &reply = values[i][k];
+            if (reply.str.empty()) {
+                report.errors.push_back(reply.name + ": no reply to set");
+            } else if (reply.str.find("not found") != std::string::npos) {
+                report.errors.push_back(reply.name + ": " + reply.str);
+            }
+        }
+        for (size_t k=0; verify && k<n; k++) {
+            auto &v = set.values[written[i][k]];
+            TextAPIValue wrote = {v.first, v.second};
+            const TextAPIValue &read = values[i][n + k];
+            if (!same_value(wrote, read)) {
+                report.errors.push_back(wrote.name + ": wrote " + wrote.str + ", read back " + read.str);
+            }
+        }
+        reports.push_back(report);
+    }
+    return reports;
+}
+
+void MotorManager::set_commands(const std::vector<Command> &commands) {
+    set_commands(commands.data(), commands.size());
+}
+
+void MotorManager::set_commands(const Command *commands, size_t num_commands) {
+    std::copy(commands, commands + std::min(num_commands, commands_.size()), commands_.begin());
 }
 
 void MotorManager::set_command_count(int32_t count) {
@@ -195,37 +638,37 @@ void MotorManager::set_command_mode(uint8_t mode) {
     }
 }
 
-void MotorManager::set_command_mode(std::vector<uint8_t> mode) {
+void MotorManager::set_command_mode(const std::vector<uint8_t> &mode) {
     for (int i=0; i<commands_.size(); i++) {
         commands_[i].mode_desired = mode[i];
     }
 }
     
-void MotorManager::set_command_current(std::vector<float> current) {
+void MotorManager::set_command_current(const std::vector<float> &current) {
     for (int i=0; i<commands_.size(); i++) {
         commands_[i].current_desired = current[i];
     }
 }
 
-void MotorManager::set_command_position(std::vector<float> position) {
+void MotorManager::set_command_position(const std::vector<float> &position) {
     for (int i=0; i<commands_.size(); i++) {
         commands_[i].position_desired = position[i];
     }
 }
 
-void MotorManager::set_command_velocity(std::vector<float> velocity) {
+void MotorManager::set_command_velocity(const std::vector<float> &velocity) {
     for (int i=0; i<commands_.size(); i++) {
         commands_[i].velocity_desired = velocity[i];
     }
 }
 
-void MotorManager::set_command_torque(std::vector<float> torque) {
+void MotorManager::set_command_torque(const std::vector<float> &torque) {
     for (int i=0; i<commands_.size(); i++) {
         commands_[i].torque_desired = torque[i];
     }
 }
 
-void MotorManager::set_command_reserved(std::vector<float> reserved) {
+void MotorManager::set_command_reserved(const std::vector<float> &reserved) {
     for (int i=0; i<commands_.size(); i++) {
         commands_[i].reserved = reserved[i];
     }
@@ -309,14 +752,11 @@ bool MotorManager::deserialize_saved_commands(char *data) {
 }
 
 int MotorManager::poll() {
-    auto pollfds = new pollfd[motors_.size()];
     for (int i=0; i<motors_.size(); i++) {
-        pollfds[i].fd = motors_[i]->fd();
-        pollfds[i].events = POLLIN;
+        pollfds_[i].fd = motors_[i]->fd();
+        pollfds_[i].events = POLLIN;
     }
-    int retval = ::poll(pollfds, motors_.size(), 1);
-    delete [] pollfds;
-    return retval;
+    return ::poll(pollfds_.data(), motors_.size(), 1);
 }
 
 std::string MotorManager::command_headers() const {
@@ -337,6 +777,9 @@ std::string MotorManager::command_headers() const {
     for (int i=0;i<length;i++) {
         ss << "velocity_desired" << i << ", ";
     }
+    for (int i=0;i<length;i++) {
+        ss << "torque_desired" << i << ", ";
+    }
     for (int i=0;i<length;i++) {
         ss << "reserved" << i << ", ";
     }
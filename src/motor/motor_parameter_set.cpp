@@ -0,0 +1,55 @@
+#include "motor_parameter_set.h"
+#include <stdexcept>
+
+void write_parameter_sets(std::ostream &os, const std::vector<MotorParameterSet> &sets) {
+    for (size_t i=0; i<sets.size(); i++) {
+        if (i) {
+            os << "\n";
+        }
+        os << "motor=" << sets[i].name << "\n";
+        os << "serial_number=" << sets[i].serial_number << "\n";
+        os << "version=" << sets[i].version << "\n";
+        for (auto &v : sets[i].values) {
+            os << v.first << "=" << v.second << "\n";
+        }
+    }
+}
+
+std::vector<MotorParameterSet> read_parameter_sets(std::istream &is) {
+    std::vector<MotorParameterSet> sets;
+    std::string line;
+    int line_number = 0;
+    while (std::getline(is, line)) {
+        line_number++;
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        auto pos = line.find('=');
+        if (pos == std::string::npos) {
+            throw std::runtime_error("Parameter file line " + std::to_string(line_number) + " is not name=value: " + line);
+        }
+        std::string key = line.substr(0, pos), value = line.substr(pos + 1);
+        if (key == "motor") {
+            sets.push_back(MotorParameterSet());
+            sets.back().name = value;
+        } else if (sets.empty()) {
+            throw std::runtime_error("Parameter file line " + std::to_string(line_number) + " comes before any motor=");
+        } else if (key == "serial_number") {
+            sets.back().serial_number = value;
+        } else if (key == "version") {
+            sets.back().version = value;
+        } else {
+            sets.back().values.push_back({key, value});
+        }
+    }
+    return sets;
+}
+
+std::ostream &operator<<(std::ostream &os, const MotorParameterReport &report) {
+    os << report.name << ": " << report.parameters << " parameters in "
+       << std::chrono::duration<double, std::milli>(report.time).count() << " ms";
+    for (auto &error : report.errors) {
+        os << "\n  " << error;
+    }
+    return os;
+}
@@ -0,0 +1,188 @@
+#include "motor_parameters.h"
+#include "motor.h"
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <fstream>
+#include <stdexcept>
+
+static const char *kDefaultConstants[] = {"cpu_frequency", "mcpr", "ocpr", "irange"};
+
+MotorParameters::MotorParameters(Motor &motor)
+        : motor_(motor), constants_(std::begin(kDefaultConstants), std::end(kDefaultConstants)) {}
+
+double MotorParameters::get(const std::string &name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const Value &v = value(name);
+    if (!v.is_number) {
+        throw std::runtime_error("Motor parameter " + name + " is not a number: " + v.str);
+    }
+    return v.number;
+}
+
+std::string MotorParameters::get_string(const std::string &name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return value(name).str;
+}
+
+void MotorParameters::add_constant(const std::string &name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (std::find(constants_.begin(), constants_.end(), name) == constants_.end()) {
+        constants_.push_back(name);
+    }
+}
+
+bool MotorParameters::constant(const std::string &name) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return is_constant(name);
+}
+
+bool MotorParameters::is_constant(const std::string &name) const {
+    return std::find(constants_.begin(), constants_.end(), name) != constants_.end();
+}
+
+void MotorParameters::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    values_.clear();
+    file_loaded_ = true;
+    std::string path = cache_path();
+    if (path.size()) {
+        std::remove(path.c_str());
+    }
+}
+
+std::string MotorParameters::cache_dir() {
+    if (const char *dir = std::getenv("MOTOR_PARAMETER_CACHE")) {
+        return dir;
+    }
+    if (const char *dir = std::getenv("XDG_CACHE_HOME")) {
+        return std::string(dir) + "/motor_parameters";
+    }
+    if (const char *home = std::getenv("HOME")) {
+        return std::string(home) + "/.cache/motor_parameters";
+    }
+    return "";
+}
+
+std::string MotorParameters::cache_path() const {
+    std::string dir = cache_dir();
+    if (dir.empty() || motor_.serial_number().empty() || motor_.version().empty()) {
+        return "";
+    }
+    // versions can have spaces and slashes, the file also records them as is
+    std::string file = motor_.serial_number() + "-" + motor_.version();
+    for (auto &c : file) {
+        if (!isalnum(static_cast<unsigned char>(c)) && c != '.' && c != '-' && c != '_') {
+            c = '_';
+        }
+    }
+    return dir + "/" + file;
+}
+
+const MotorParameters::Value &MotorParameters::value(const std::string &name) {
+    auto it = values_.find(name);
+    if (it != values_.end()) {
+        return it->second;
+    }
+    if (!is_constant(name)) {
+        throw std::runtime_error("Motor parameter " + name + " is not a constant, read it through the text api");
+    }
+    if (!file_loaded_) {
+        file_loaded_ = true;
+        load_from_file();
+    }
+    it = values_.find(name);
+    if (it == values_.end()) {
+        load_from_motor();
+        save();
+        it = values_.find(name);
+    }
+    return it->second;
+}
+
+void MotorParameters::load_from_motor() {
+    TextAPIBatch batch = motor_.text_batch();
+    for (auto &name : constants_) {
+        if (!values_.count(name)) {
+            batch.get(name);
+        }
+    }
+    for (auto &v : batch.run()) {
+        bool is_number = v.is_number();
+        values_[v.name] = {v.str, is_number, is_number ? v.as_double() : 0};
+    }
+}
+
+// # motor parameters
+// serial_number=...
+// version=...
+// messages_version=...
+// name=value, for each constant
+void MotorParameters::load_from_file() {
+    std::string path = cache_path();
+    if (path.empty()) {
+        return;
+    }
+    std::ifstream f(path);
+    std::string line;
+    std::unordered_map<std::string, std::string> entries;
+    while (std::getline(f, line)) {
+        auto pos = line.find('=');
+        if (line.size() && line[0] != '#' && pos != std::string::npos) {
+            entries[line.substr(0, pos)] = line.substr(pos + 1);
+        }
+    }
+    if (entries["serial_number"] != motor_.serial_number() || entries["version"] != motor_.version() ||
+            entries["messages_version"] != MOTOR_MESSAGES_VERSION) {
+        return;
+    }
+    for (auto &name : constants_) {
+        auto it = entries.find(name);
+        if (it != entries.end()) {
+            TextAPIValue v = {name, it->second};
+            if (v.is_number()) {
+                values_[name] = {v.str, true, v.as_double()};
+            }
+        }
+    }
+}
+
+void MotorParameters::save() {
+    std::string path = cache_path();
+    if (path.empty() || !motor_.check_messages_version()) {
+        return;
+    }
+    // mkdir -p, best effort as the cache is optional
+    std::string dir = cache_dir();
+    for (size_t pos = dir.find('/', 1); ; pos = dir.find('/', pos + 1)) {
+        ::mkdir(dir.substr(0, pos).c_str(), 0755);
+        if (pos == std::string::npos) {
+            break;
+        }
+    }
+    std::string tmp = path + "." + std::to_string(getpid());
+    {
+        std::ofstream f(tmp);
+        f << "# motor parameters\n";
+        f << "serial_number=" << motor_.serial_number() << "\n";
+        f << "version=" << motor_.version() << "\n";
+        f << "messages_version=" << MOTOR_MESSAGES_VERSION << "\n";
+        for (auto &name : constants_) {
+            auto it = values_.find(name);
+            // error replies are not worth keeping
+            if (it != values_.end() && it->second.is_number) {
+                f << name << "=" << it->second.str << "\n";
+            }
+        }
+        if (!f) {
+            std::remove(tmp.c_str());
+            return;
+        }
+    }
+    // atomic for other processes reading it
+    if (std::rename(tmp.c_str(), path.c_str()) < 0) {
+        std::remove(tmp.c_str());
+    }
+}
@@ -10,10 +10,17 @@
 #include <signal.h>
 #include <string>
 #include "motor_publisher.h"
+#include "cycle_data.h"
+#include "motor_recorder.h"
+#include "motor_format.h"
 #include <sstream>
+#include <fstream>
 #include "realtime_thread.h"
+#include "cycle_stats.h"
+#include "wake_timer.h"
+#include "perf_counters.h"
+#include "firmware_log.h"
 
-struct cstr{char s[100];};
 class Statistics {
  public:
     Statistics(int size = 100) : size_(size) {}
@@ -65,6 +72,11 @@ struct ReadOptions {
     bool read_write_statistics;
     bool reserved_float;
     std::vector<double> bits;
+    bool io_uring;
+    std::string log;
+    bool cycle_stats;
+    WakeTimer::Mode wake;
+    bool perf_counters;
 };
 
 bool signal_exit = false;
@@ -95,10 +107,14 @@ int main(int argc, char** argv) {
     int run_stats = 100;
     bool allow_simulated = false;
     bool check_messages_version = false;
+    std::string backup_filename, restore_filename;
+    std::vector<std::string> backup_parameters;
+    bool no_verify = false;
     ReadOptions read_opts = { .poll = false, .aread = false, .frequency_hz = 1000, 
         .statistics = false, .text = {"log"} , .timestamp_in_seconds = false, .host_time = false, 
         .publish = false, .csv = false, .reconnect = false, .read_write_statistics = false,
-        .reserved_float = false, .bits={100,1}};
+        .reserved_float = false, .bits={100,1}, .io_uring = false, .log = "", .cycle_stats = false,
+        .wake = WakeTimer::SLEEP, .perf_counters = false};
     auto set = app.add_subcommand("set", "Send data to motor(s)");
     set->add_option("--host_time", command.host_timestamp, "Host time");
     set->add_option("--mode", command.mode_desired, "Mode desired")->transform(CLI::CheckedTransformer(mode_map, CLI::ignore_case));
@@ -134,13 +150,26 @@ int main(int argc, char** argv) {
     read_option->add_option("--frequency", read_opts.frequency_hz , "Read frequency in Hz");
     read_option->add_flag("--statistics", read_opts.statistics, "Print statistics rather than values");
     read_option->add_flag("--read-write-statistics", read_opts.read_write_statistics, "Perform read then write when doing statistics test");
-    auto text_read = read_option->add_option("--text",read_opts.text, "Read the text api for variable", true)->expected(0, -1);
+    auto text_read = read_option->add_option("--text",read_opts.text, "Read the text api for variable, or log alone for the firmware logs of all motors selected", true)->expected(0, -1);
     read_option->add_flag("-t,--host-time-seconds",read_opts.host_time, "Print host read time");
-    read_option->add_flag("--publish", read_opts.publish, "Publish joint data to shared memory");
+    read_option->add_flag("--publish", read_opts.publish, "Publish statuses and commands to shared memory, see motor_data_echo");
     read_option->add_flag("--csv", read_opts.csv, "Convenience to set --no-list, --host-time-seconds, and --timestamp-in-seconds");
     read_option->add_flag("-f,--reserved-float", read_opts.reserved_float, "Interpret reserved 1 & 2 as floats rather than uint32");
     read_option->add_flag("-r,--reconnect", read_opts.reconnect, "Try to reconnect by usb path");
+    read_option->add_flag("--io-uring", read_opts.io_uring, "Batch reads and writes with io_uring");
+    std::vector<std::pair<std::string, WakeTimer::Mode>> wake_map{
+        {"sleep", WakeTimer::SLEEP}, {"spin", WakeTimer::SPIN}, {"hybrid", WakeTimer::HYBRID}, {"timerfd", WakeTimer::TIMERFD}};
+    read_option->add_option("--wake", read_opts.wake, "How to wait for the next read: sleep, spin, hybrid (sleep then spin), or timerfd")->transform(CLI::CheckedTransformer(wake_map, CLI::ignore_case));
+    read_option->add_flag("--cycle-stats", read_opts.cycle_stats, "Print wake latency, execution time and overrun statistics on exit");
+    read_option->add_flag("--perf-counters", read_opts.perf_counters, "Print cycles, instructions, cache misses, context switches, page faults and migrations per phase of each read on exit, software counters if the PMU is not accessible");
+    read_option->add_option("--log", read_opts.log, "Record to a binary motor log rather than print, see motor_log_export")->type_name("FILE");
     auto bits_option = read_option->add_option("--bits", read_opts.bits, "Process noise and display bits, ±3σ window 100 [experimental]", true)->type_name("NUM_SAMPLES RANGE")->expected(0,2);
+    auto backup = app.add_subcommand("backup", "Save text api parameters of all motors at once to a file");
+    backup->add_option("file", backup_filename, "Parameter file, see restore")->type_name("FILE")->required();
+    backup->add_option("--parameters", backup_parameters, "Text api parameters to save")->type_name("NAME")->expected(-1)->required();
+    auto restore = app.add_subcommand("restore", "Write parameters from a backup file to all motors at once and read them back");
+    restore->add_option("file", restore_filename, "Parameter file from backup, matched to motors by serial number then name")->type_name("FILE")->required();
+    restore->add_flag("--no-verify", no_verify, "Do not read back parameters after writing");
     app.add_flag("-l,--list", verbose_list, "Verbose list connected motors");
     app.add_flag("-c,--check-messages-version", check_messages_version, "Check motor messages version");
     app.add_flag("--no-list", no_list, "Do not list connected motors");
@@ -260,30 +289,66 @@ int main(int argc, char** argv) {
     if (*run_stats_option && motors.size()) {
         std::cout << "name, max_fast_loop_cycles, max_fast_loop_period, max_main_loop_cycles, max_main_loop_period, " << 
                 "mean_fast_loop_cycles, mean_fast_loop_period, mean_main_loop_cycles, mean_main_loop_period" << std::endl;
-        for (auto m : motors) {
-            auto max_api_val = [run_stats](TextAPIItem a) {
-                int out = 0;
-                for (int i=0;i<run_stats;i++) {
-                    out = std::max(std::atoi(a.get().c_str()), out);
-                } 
-                return out;
-            };
-            auto mean_api_val = [run_stats](TextAPIItem a) {
-                double out = 0;
-                for (int i=0;i<run_stats;i++) {
-                    out += (double) std::atoi(a.get().c_str())/run_stats;
-                } 
-                return out;
-            };
-            std::cout << m->name() << ", ";
-            std::cout << max_api_val((*m)["t_exec_fastloop"]) << ", ";
-            std::cout << max_api_val((*m)["t_period_fastloop"]) << ", ";
-            std::cout << max_api_val((*m)["t_exec_mainloop"]) << ", ";
-            std::cout << max_api_val((*m)["t_period_mainloop"]) << ", ";
-            std::cout << mean_api_val((*m)["t_exec_fastloop"]) << ", ";
-            std::cout << mean_api_val((*m)["t_period_fastloop"]) << ", ";
-            std::cout << mean_api_val((*m)["t_exec_mainloop"]) << ", ";
-            std::cout << mean_api_val((*m)["t_period_mainloop"]) << std::endl;
+        // all samples of a motor in one transaction, all motors at once
+        std::vector<std::string> stats = {"t_exec_fastloop", "t_period_fastloop", "t_exec_mainloop", "t_period_mainloop"};
+        std::vector<std::string> names;
+        for (int i=0; i<run_stats; i++) {
+            names.insert(names.end(), stats.begin(), stats.end());
+        }
+        auto values = m.get_text(names);
+        for (int j=0; j<motors.size(); j++) {
+            std::vector<int> max(stats.size());
+            std::vector<double> mean(stats.size());
+            for (int i=0; i<values[j].size(); i++) {
+                int value = std::atoi(values[j][i].str.c_str());
+                max[i % stats.size()] = std::max(value, max[i % stats.size()]);
+                mean[i % stats.size()] += (double) value/run_stats;
+            }
+            std::cout << motors[j]->name();
+            for (auto v : max) {
+                std::cout << ", " << v;
+            }
+            for (auto v : mean) {
+                std::cout << ", " << v;
+            }
+            std::cout << std::endl;
+        }
+    }
+
+    if (*backup && motors.size()) {
+        std::vector<MotorParameterReport> reports;
+        auto sets = m.snapshot_parameters(backup_parameters, &reports);
+        std::ofstream f(backup_filename);
+        write_parameter_sets(f, sets);
+        f.close();
+        if (!f) {
+            std::cerr << "Error writing " << backup_filename << std::endl;
+            return 1;
+        }
+        bool ok = true;
+        for (auto &report : reports) {
+            std::cout << report << std::endl;
+            ok = ok && report.ok();
+        }
+        if (!ok) {
+            return 1;
+        }
+    }
+
+    if (*restore && motors.size()) {
+        std::ifstream f(restore_filename);
+        if (!f) {
+            std::cerr << "Error opening " << restore_filename << std::endl;
+            return 1;
+        }
+        auto reports = m.restore_parameters(read_parameter_sets(f), !no_verify);
+        bool ok = true;
+        for (auto &report : reports) {
+            std::cout << report << std::endl;
+            ok = ok && report.ok();
+        }
+        if (!ok) {
+            return 1;
         }
     }
 
@@ -293,7 +358,14 @@ int main(int argc, char** argv) {
         m.write_saved_commands();
     }
 
-    if (api_mode || *read_option && *text_read) {
+    // the firmware log of any number of motors, other text reads of one
+    bool text_log = *read_option && *text_read &&
+        std::find(read_opts.text.begin(), read_opts.text.end(), "log") != read_opts.text.end();
+    if (text_log && read_opts.text.size() > 1) {
+        std::cout << "Read --text log on its own, not with other variables" << std::endl;
+        return 1;
+    }
+    if (api_mode || (*read_option && *text_read && !text_log)) {
         if (motors.size() != 1) {
             std::cout << "Select one motor to use api mode" << std::endl;
             return 1;
@@ -335,15 +407,37 @@ int main(int argc, char** argv) {
         }
         
         m.set_reconnect(read_opts.reconnect);
+        if (read_opts.io_uring) {
+            m.set_io_uring();
+        }
         
-        if (*text_read) {
+        if (text_log) {
+            // only log, drained in batches on its own thread
+            auto poll_period = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::duration<double>(1/read_opts.frequency_hz));
+            FirmwareLog firmware_log(m.motors(), std::max(poll_period, std::chrono::milliseconds(1)), m.hotplug());
+            auto reader = firmware_log.reader();
+            auto start_time = std::chrono::steady_clock::now().time_since_epoch();
+            FirmwareLogEntry entries[64];
+            while(!signal_exit) {
+                while (size_t n = reader.read(entries, 64)) {
+                    for (size_t i=0; i<n; i++) {
+                        if (read_opts.host_time) {
+                            std::cout << (entries[i].host_time_ns - std::chrono::duration_cast<std::chrono::nanoseconds>(start_time).count())/1e9 << ", ";
+                        }
+                        if (m.motors().size() > 1) {
+                            std::cout << m.motors()[entries[i].motor]->name() << ": ";
+                        }
+                        std::cout << entries[i].str() << std::endl;
+                    }
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            if (reader.lost()) {
+                std::cerr << "Lost " << reader.lost() << " firmware log messages" << std::endl;
+            }
+        } else if (*text_read) {
             std::vector<TextAPIItem> log;
             for (auto s : read_opts.text) {
-                if (s == "log") {
-                    // only log
-                    log = {(*m.motors()[0])[s]};
-                    break;
-                }
                 log.push_back((*m.motors()[0])[s]);
             }
             RealtimeThread text_thread(read_opts.frequency_hz, [&](){
@@ -380,6 +474,8 @@ int main(int argc, char** argv) {
                 }
                 std::cout << std::endl;
             } else if (*bits_option) {
+                // load the constants before timing starts
+                m.motors()[0]->parameters().get("mcpr");
                 std::cout << "motor_encoder, output_encoder, iq" << std::endl;
             } else {
                 if (read_opts.host_time) {
@@ -388,7 +484,7 @@ int main(int argc, char** argv) {
                 if (read_opts.timestamp_in_seconds) {
                     int length = motors.size();
                     for (int i=0;i<length;i++) {
-                        cpu_frequency_hz[i] = std::stod((*m.motors()[i])["cpu_frequency"].get()); // TODO has issues if you run it in first few seconds
+                        cpu_frequency_hz[i] = m.motors()[i]->parameters().get("cpu_frequency"); // TODO has issues if you run it in first few seconds
                         std::cout << "t_seconds" << i << ", ";
                     }
                 }
@@ -400,37 +496,94 @@ int main(int argc, char** argv) {
             int64_t period_ns = 1e9/read_opts.frequency_hz;
             Statistics exec(100), period(100), hops(100*m.motors().size());
             int i = 0;
-            MotorPublisher<cstr> pub;
+            std::unique_ptr<MotorPublisher<Data>> pub;
+            Data pub_data = {};
+            if (read_opts.publish) {
+                if (m.motors().size() > Data::max_motors) {
+                    throw std::runtime_error("Too many motors to publish, maximum is " + std::to_string(Data::max_motors));
+                }
+                pub.reset(new MotorPublisher<Data>());
+                pub_data.num_motors = m.motors().size();
+            }
+            // segments are encoded and written on the recorder's thread, not in
+            // the loop. On the stack as new ignores its alignment before C++17,
+            // the queue only needs room when logging.
+            bool recording = read_opts.log.size();
+            MotorRecorder recorder(recording ? 4096 : 1);
+            Data log_data = {};
+            MotorFormatter format;
+            format.set_aligned();
+            format.set_fixed();
+            if (recording) {
+                if (m.motors().size() > Data::max_motors) {
+                    throw std::runtime_error("Too many motors to log, maximum is " + std::to_string(Data::max_motors));
+                }
+                std::vector<std::string> names;
+                for (auto motor : m.motors()) {
+                    names.push_back(motor->name());
+                }
+                recorder.start_log(read_opts.log, names);
+                log_data.num_motors = m.motors().size();
+            }
+            CycleStats cycle_stats;
+            WakeTimer wake_timer(read_opts.wake);
+            std::vector<std::string> motor_names;
+            for (auto motor : m.motors()) {
+                motor_names.push_back(motor->name());
+            }
+            // reads do not throw, errors are counted and reported once a second
+            MotorErrorReporter error_reporter(motor_names);
+            FrequencyLimiter error_rate(std::chrono::milliseconds(1000));
+            enum { AREAD_PHASE, READ_PHASE, OUTPUT_PHASE };
+            std::unique_ptr<PhaseCounters> perf_counters;
+            if (read_opts.perf_counters) {
+                perf_counters.reset(new PhaseCounters({"aread", "read", "output"}));
+                perf_counters->open();
+            }
             while (!signal_exit) {
                 auto last_loop_start_time = loop_start_time;
                 loop_start_time = std::chrono::steady_clock::now();
+                auto wake_target = next_time;
                 next_time += std::chrono::nanoseconds(period_ns);
+                if (perf_counters) {
+                    perf_counters->start();
+                }
                 if (read_opts.aread) {
                     m.aread();
                 }
                 if (read_opts.poll) {
                     m.poll();
                 }
+                if (perf_counters) {
+                    perf_counters->end(AREAD_PHASE);
+                }
                 
                 auto status = m.read();
                 auto exec_time = std::chrono::steady_clock::now();
+                if (perf_counters) {
+                    perf_counters->end(READ_PHASE);
+                }
 
-                if (read_opts.publish) {
-                    std::ostringstream oss;
-                    for (auto stat : status) {
-                        oss << stat.joint_position << " ";
-                    }
-                    oss << std::endl;
-                    cstr c;
-                    std::strncpy(c.s, oss.str().c_str(), 100);
-                    pub.publish(c);
+                if (pub) {
+                    pub_data.last_time_start = pub_data.time_start;
+                    pub_data.time_start = loop_start_time;
+                    pub_data.read_time = exec_time;
+                    std::copy(status.begin(), status.end(), pub_data.statuses);
+                    std::copy(m.commands().begin(), m.commands().end(), pub_data.commands);
+                    pub->publish(pub_data);
                 }
 
-                if (*bits_option) {
+                if (recording) {
+                    log_data.time_start = loop_start_time;
+                    log_data.read_time = exec_time;
+                    std::copy(status.begin(), status.end(), log_data.statuses);
+                    std::copy(m.commands().begin(), m.commands().end(), log_data.commands);
+                    recorder.buffer().push(log_data);
+                } else if (*bits_option) {
                     static Statistics motor_encoder(read_opts.bits[0]), output_encoder(read_opts.bits[0]), iq(read_opts.bits[0]);
-                    static double mcpr = fabs(std::stod((*m.motors()[i])["mcpr"].get()));
-                    static double ocpr = fabs(std::stod((*m.motors()[i])["ocpr"].get()));
-                    static double irange = fabs(std::stod((*m.motors()[i])["irange"].get()));
+                    static double mcpr = fabs(m.motors()[i]->parameters().get("mcpr"));
+                    static double ocpr = fabs(m.motors()[i]->parameters().get("ocpr"));
+                    static double irange = fabs(m.motors()[i]->parameters().get("irange"));
                     motor_encoder.push(status[0].motor_encoder);
                     output_encoder.push(status[0].joint_position);
                     iq.push(status[0].iq);
@@ -463,13 +616,11 @@ int main(int argc, char** argv) {
                         m.write_saved_commands();
                     }
                 } else {
-                    std::cout << std::fixed;
-                    std::cout << std::setprecision(9);
-                    if (!read_opts.reserved_float) {
-                        std::cout << reserved_uint32;
-                    }
+                    format.clear();
+                    format.set_precision(9);
+                    format.set_reserved_uint32(!read_opts.reserved_float);
                     if (read_opts.host_time) {
-                        std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(loop_start_time - start_time).count()/1e9 << ", ";
+                        format.append(std::chrono::duration_cast<std::chrono::nanoseconds>(loop_start_time - start_time).count()/1e9).append(", ");
                     }
                     if (read_opts.timestamp_in_seconds) {
                         
@@ -478,17 +629,37 @@ int main(int argc, char** argv) {
                         for (int i = 0; i < status.size(); i++) {
                             uint32_t dt = status[i].mcu_timestamp - last_status[i].mcu_timestamp;
                             t_seconds[i] += dt/cpu_frequency_hz[i];
-                            std::cout << t_seconds[i] << ", ";
+                            format.append(t_seconds[i]).append(", ");
                         }
                         last_status = status;
                     }
-                    std::cout << std::setprecision(5);
-                    std::cout << status << std::endl;
+                    format.set_precision(5);
+                    format.append(status).append('\n');
+                    std::cout.write(format.data(), format.size()).flush();
+                }
+
+                if (perf_counters) {
+                    perf_counters->end(OUTPUT_PHASE);
+                }
+                cycle_stats.record(wake_target, loop_start_time, std::chrono::steady_clock::now(), next_time);
+                if (error_rate.run()) {
+                    std::cerr << error_reporter.report(m.errors());
                 }
 
-                // option to not sleep
-                // while (std::chrono::steady_clock::now() < next_time);
-                std::this_thread::sleep_until(next_time);
+                wake_timer.wait_until(next_time);
+            }
+            std::cerr << error_reporter.report(m.errors());
+            if (recording) {
+                recorder.stop();
+                if (recorder.overflows()) {
+                    std::cerr << "Dropped " << recorder.overflows() << " log records" << std::endl;
+                }
+            }
+            if (read_opts.cycle_stats) {
+                std::cerr << cycle_stats.snapshot() << std::endl;
+            }
+            if (perf_counters) {
+                std::cerr << perf_counters->snapshot() << std::endl;
             }
         }
     }
@@ -15,6 +15,8 @@ _motor_util_completion()
         case ${COMP_WORDS[$i]} in
             set) subcommand=set ; break ;; 
             read) subcommand=read ; break ;;
+            backup) subcommand=backup ; break ;;
+            restore) subcommand=restore ; break ;;
             --set_api) subcommand=set_api ; break ;;
             -n|--names) subcommand=names ; break ;;
             -p|--paths) subcommand=paths ; break ;;
@@ -28,17 +30,22 @@ _motor_util_completion()
 
     COMREPLY=()
     local words
-    local base_words="-l --list -c --check-messages-version --no-list --list-names-only --list-path-only --list-devpath-only --list-serial-number-only -n --names -p --paths -d --devpaths -s --serial_numbers set read --set-api --api --run-stats -v --version -u --user-space --allow-simulated -h --help";
+    local base_words="-l --list -c --check-messages-version --no-list --list-names-only --list-path-only --list-devpath-only --list-serial-number-only -n --names -p --paths -d --devpaths -s --serial_numbers set read backup restore --set-api --api --run-stats -v --version -u --user-space --allow-simulated -h --help";
     case $subcommand in
         set) words="--host_time --mode --current --position --velocity --torque --reserved  position_tuning current_tuning stepper_tuning voltage stepper_velocity read -h --help";
             case $last in
                 --host_time|--current|--position|--velocity|--reserved) return 0 ;;
                 --mode) words="open damped current position velocity torque impedance current_tuning position_tuning voltage phase_lock stepper_tuning sleep crash reset" ;;
             esac ;;
-        read) words="--poll --aread --frequency --statistics --read-write-statistics --text -s --timestamp-in-seconds -t --host-time-seconds --publish --csv -f --reserved-float -r --reconnect --bits set -h --help";
+        read) words="--poll --aread --frequency --statistics --read-write-statistics --text -s --timestamp-in-seconds -t --host-time-seconds --publish --csv -f --reserved-float -r --reconnect --io-uring --log --cycle-stats --perf-counters --wake --bits set -h --help";
             case $last in
                 --frequency) return 0 ;;
             esac ;;
+        backup) words="--parameters -h --help";
+            case $last in
+                --parameters) return 0 ;;
+            esac ;;
+        restore) words="--no-verify -h --help" ;;
         names) words="$(motor_util --list-names-only) $base_words" ;;
         paths) words="$(motor_util --list-path-only) $base_words" ;;
         devpaths) words="$(motor_util --list-devpath-only) $base_words" ;;
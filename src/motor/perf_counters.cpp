@@ -0,0 +1,230 @@
+#include "perf_counters.h"
+#include <linux/perf_event.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+
+struct PerfEvent {
+    PerfCounters::Counter counter;
+    uint32_t type;
+    uint64_t config;
+};
+
+// hardware first so that a hardware counter leads the group when there is one
+static const PerfEvent kPerfEvents[] = {
+    {PerfCounters::CYCLES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PerfCounters::INSTRUCTIONS, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PerfCounters::CACHE_MISSES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PerfCounters::TASK_CLOCK, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+    {PerfCounters::CONTEXT_SWITCHES, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    {PerfCounters::PAGE_FAULTS, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+    {PerfCounters::MIGRATIONS, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS},
+};
+
+// user_only is set when perf_event_paranoid 2 only allows counting user
+// space, where the kernel never counts context switches or migrations
+static int perf_event_open(uint32_t type, uint64_t config, int group_fd, bool *user_only) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_hv = 1;
+    *user_only = false;
+    int fd = syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC);
+    if (fd < 0 && (errno == EACCES || errno == EPERM)) {
+        attr.exclude_kernel = 1;
+        *user_only = true;
+        fd = syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC);
+    }
+    return fd;
+}
+
+static const uint32_t kRusageCounters = 1u << PerfCounters::TASK_CLOCK | 1u << PerfCounters::CONTEXT_SWITCHES |
+                                        1u << PerfCounters::PAGE_FAULTS | 1u << PerfCounters::MIGRATIONS;
+// counters that read zero with exclude_kernel
+static const uint32_t kKernelOnlyCounters = 1u << PerfCounters::CONTEXT_SWITCHES | 1u << PerfCounters::MIGRATIONS;
+
+void PerfCounters::open() {
+    close();
+    uint32_t available = 0, rusage = 0;
+    bool hardware = false;
+    for (auto &e : kPerfEvents) {
+        group_index_[e.counter] = -1;
+        bool user_only;
+        int fd = perf_event_open(e.type, e.config, num_fds_ ? fds_[0] : -1, &user_only);
+        if (fd >= 0 && user_only && (kKernelOnlyCounters & 1u << e.counter)) {
+            ::close(fd);
+            rusage |= 1u << e.counter;
+        } else if (fd >= 0) {
+            group_index_[e.counter] = num_fds_;
+            fds_[num_fds_++] = fd;
+            available |= 1u << e.counter;
+            hardware |= e.type == PERF_TYPE_HARDWARE;
+        }
+    }
+    Source source = hardware ? HARDWARE : SOFTWARE;
+    if (!num_fds_) {
+        source = RUSAGE;
+        rusage = kRusageCounters;
+    }
+    if (rusage) {
+        available |= rusage;
+        last_cpu_ = sched_getcpu();
+        migrations_ = 0;
+    }
+    rusage_.store(rusage, std::memory_order_release);
+    available_.store(available, std::memory_order_release);
+    source_.store(source, std::memory_order_release);
+}
+
+void PerfCounters::close() {
+    for (int i=0; i<num_fds_; i++) {
+        ::close(fds_[i]);
+    }
+    num_fds_ = 0;
+    available_.store(0, std::memory_order_release);
+    rusage_.store(0, std::memory_order_release);
+    source_.store(CLOSED, std::memory_order_release);
+}
+
+bool PerfCounters::read_rusage(Values *values, uint32_t counters) {
+    rusage usage;
+    timespec ts;
+    if (getrusage(RUSAGE_THREAD, &usage) < 0 ||
+            (counters & 1u << TASK_CLOCK && clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) < 0)) {
+        return false;
+    }
+    // only noticed at each read, not every migration in between
+    int cpu = sched_getcpu();
+    if (cpu != last_cpu_) {
+        last_cpu_ = cpu;
+        migrations_++;
+    }
+    if (counters & 1u << TASK_CLOCK) {
+        values->value[TASK_CLOCK] = ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    }
+    if (counters & 1u << CONTEXT_SWITCHES) {
+        values->value[CONTEXT_SWITCHES] = usage.ru_nvcsw + usage.ru_nivcsw;
+    }
+    if (counters & 1u << PAGE_FAULTS) {
+        values->value[PAGE_FAULTS] = usage.ru_minflt + usage.ru_majflt;
+    }
+    if (counters & 1u << MIGRATIONS) {
+        values->value[MIGRATIONS] = migrations_;
+    }
+    return true;
+}
+
+void PerfCounters::read(Values *values) {
+    uint32_t rusage = rusage_.load(std::memory_order_relaxed);
+    switch (source()) {
+        case CLOSED:
+            return;
+        case RUSAGE: {
+            Values v = {};
+            if (read_rusage(&v, rusage)) {
+                *values = v;
+            }
+            return;
+        }
+        default: {
+            // {nr, values in the order they were added to the group}
+            uint64_t buf[1 + kNumCounters];
+            if (::read(fds_[0], buf, sizeof(buf)) < static_cast<ssize_t>(sizeof(uint64_t) * (1 + num_fds_))) {
+                return;
+            }
+            Values v;
+            for (int c=0; c<kNumCounters; c++) {
+                v.value[c] = group_index_[c] >= 0 ? buf[1 + group_index_[c]] : 0;
+            }
+            if (rusage && !read_rusage(&v, rusage)) {
+                return;
+            }
+            *values = v;
+            return;
+        }
+    }
+}
+
+const char *PerfCounters::name(Counter c) {
+    switch (c) {
+        case CYCLES: return "cycles";
+        case INSTRUCTIONS: return "instructions";
+        case CACHE_MISSES: return "cache_misses";
+        case TASK_CLOCK: return "task_clock_ns";
+        case CONTEXT_SWITCHES: return "context_switches";
+        case PAGE_FAULTS: return "page_faults";
+        case MIGRATIONS: return "migrations";
+        default: return "unknown";
+    }
+}
+
+const char *PerfCounters::source_name(Source s) {
+    switch (s) {
+        case HARDWARE: return "hardware and software perf counters";
+        case SOFTWARE: return "software perf counters";
+        case RUSAGE: return "getrusage";
+        default: return "closed";
+    }
+}
+
+PhaseCounters::PhaseCounters(std::vector<std::string> phases)
+        : phases_(phases), histograms_(new Histogram[phases.size() * PerfCounters::kNumCounters]) {}
+
+void PhaseCounters::open() {
+    counters_.open();
+    available_ = 0;
+    for (int c=0; c<PerfCounters::kNumCounters; c++) {
+        if (counters_.available(static_cast<PerfCounters::Counter>(c))) {
+            available_ |= 1u << c;
+        }
+    }
+    counters_.read(&last_);
+}
+
+PhaseCountersSnapshot PhaseCounters::snapshot() const {
+    PhaseCountersSnapshot s;
+    s.source = PerfCounters::source_name(counters_.source());
+    if (counters_.source() != PerfCounters::RUSAGE && counters_.from_rusage(PerfCounters::CONTEXT_SWITCHES)) {
+        s.source += ", context switches and migrations from getrusage";
+    }
+    s.phases = phases_;
+    std::vector<int> counters;
+    for (int c=0; c<PerfCounters::kNumCounters; c++) {
+        if (counters_.available(static_cast<PerfCounters::Counter>(c))) {
+            counters.push_back(c);
+            s.counters.push_back(PerfCounters::name(static_cast<PerfCounters::Counter>(c)));
+        }
+    }
+    for (size_t p=0; p<phases_.size(); p++) {
+        s.histograms.emplace_back();
+        for (auto c : counters) {
+            s.histograms.back().push_back(histograms_[p * PerfCounters::kNumCounters + c].snapshot());
+        }
+    }
+    return s;
+}
+
+std::ostream &operator<<(std::ostream &os, const PhaseCountersSnapshot &s) {
+    std::ios::fmtflags flags = os.flags();
+    std::streamsize precision = os.precision();
+    os << "per phase counts from " << s.source;
+    for (size_t p=0; p<s.phases.size(); p++) {
+        for (size_t c=0; c<s.counters.size(); c++) {
+            auto &h = s.histograms[p][c];
+            os << "\n" << std::left << std::setw(18) << s.phases[p] << std::setw(17) << s.counters[c] << std::right
+               << " mean " << std::setw(12) << std::fixed << std::setprecision(2) << h.mean() << " p99 " << std::setw(10)
+               << h.percentile(.99) << " max " << std::setw(10) << h.max;
+        }
+    }
+    os.flags(flags);
+    os.precision(precision);
+    return os;
+}
@@ -9,10 +9,14 @@
 #include <linux/types.h>
 #include <sys/syscall.h>
 #include <sys/mman.h>
+#include <sched.h>
+#include <errno.h>
 
 #include <chrono>
 #include <thread>
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
 
 #define gettid() syscall(__NR_gettid)
 
@@ -70,11 +74,31 @@ return syscall(__NR_sched_getattr, pid, attr, size, flags);
 }
 
 
+static const char *policy_name(RealtimeConfig::Policy policy) {
+	switch (policy) {
+		case RealtimeConfig::DEADLINE: return "SCHED_DEADLINE";
+		case RealtimeConfig::FIFO: return "SCHED_FIFO";
+		case RealtimeConfig::RR: return "SCHED_RR";
+		default: return "SCHED_OTHER";
+	}
+}
+
 void RealtimeThread::run() { 
 	done_ = false;
+	if (config_.lock_memory) {
+		// process wide, so done here rather than in the thread
+		if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+			std::cerr << "Error locking memory: " << strerror(errno) << std::endl;
+		}
+	}
+	started_ = std::promise<void>();
+	auto started = started_.get_future();
 	thread_ = new std::thread([=]{run_deadline();}); 
+	started.wait();
+	if (policy_ != config_.policy) {
+		std::cerr << "Realtime thread: " << report_ << std::endl;
+	}
 }
-
 void RealtimeThread::done() {
 	done_ = true; 
 	if (exit_.get_future().wait_for(std::chrono::nanoseconds(period_ns_)*2) == std::future_status::timeout) {
@@ -86,47 +110,115 @@ void RealtimeThread::done() {
 	delete thread_;
 }
 
-void RealtimeThread::run_deadline()
-{
-	//printf("realtime thread started period_ns = %d, [%ld]\n", period_ns_, gettid());
-	exit_ = std::promise<void>();
+// apply config_ to the calling thread, set policy_ and report_
+void RealtimeThread::set_scheduling() {
+	std::ostringstream report;
+	std::ostringstream errors;
+	if (config_.cpus.size()) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (auto cpu : config_.cpus) {
+			CPU_SET(cpu, &set);
+		}
+		if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+			errors << " (affinity: " << strerror(errno) << ")";
+		}
+	}
 
-	struct sched_attr attr;
+	struct sched_attr attr = {};
 	attr.size = sizeof(attr);
-	attr.sched_flags = 0;
-	attr.sched_nice = 0;
-	attr.sched_priority = 0;
-
-	attr.sched_policy = SCHED_DEADLINE;
-	attr.sched_runtime =  period_ns_*9.0/10;
-	attr.sched_deadline = period_ns_*9.0/10;
-	attr.sched_period =  period_ns_;
-
-	bool deadline_permissions = true;
-	unsigned int flags = 0;
-	auto ret = sched_setattr(0, &attr, flags);
-	if (ret < 0) {
-	//	perror("sched_setattr");
-		deadline_permissions = false;
-	//	printf("Running std::this_thread::sleep_until mode\n");
-	} else {
-	//	printf("Running deadline scheduler\n");
+	// the one period used by the loop, cycle stats and the kernel
+	if (config_.period_ns) {
+		period_ns_ = config_.period_ns;
+	}
+	uint64_t period = period_ns_;
+	std::vector<RealtimeConfig::Policy> policies = {config_.policy};
+	if (config_.policy == RealtimeConfig::DEADLINE && config_.fifo_fallback) {
+		policies.push_back(RealtimeConfig::FIFO);
+	}
+	policy_ = RealtimeConfig::OTHER;
+	for (auto policy : policies) {
+		attr.sched_priority = 0;
+		attr.sched_runtime = attr.sched_deadline = attr.sched_period = 0;
+		switch (policy) {
+			case RealtimeConfig::DEADLINE:
+				attr.sched_policy = SCHED_DEADLINE;
+				attr.sched_runtime = config_.runtime_ns ? config_.runtime_ns : period*9.0/10;
+				attr.sched_deadline = config_.deadline_ns ? config_.deadline_ns : period*9.0/10;
+				attr.sched_period = period;
+				break;
+			case RealtimeConfig::FIFO:
+				attr.sched_policy = SCHED_FIFO;
+				attr.sched_priority = config_.priority;
+				break;
+			case RealtimeConfig::RR:
+				attr.sched_policy = SCHED_RR;
+				attr.sched_priority = config_.priority;
+				break;
+			default:
+				attr.sched_policy = SCHED_OTHER;
+				break;
+		}
+		if (sched_setattr(0, &attr, 0) == 0) {
+			policy_ = policy;
+			break;
+		}
+		errors << " (" << policy_name(policy) << ": " << strerror(errno) << ")";
 	}
 
-	ret = mlockall(MCL_CURRENT | MCL_FUTURE);
-	if (ret < 0) {
-	//	perror("Error locking memory");
+	report << policy_name(policy_);
+	if (policy_ == RealtimeConfig::DEADLINE) {
+		report << " runtime " << attr.sched_runtime << " ns, deadline " << attr.sched_deadline << " ns, period " << attr.sched_period << " ns";
+	} else if (policy_ == RealtimeConfig::FIFO || policy_ == RealtimeConfig::RR) {
+		report << " priority " << config_.priority;
+	}
+	cpu_set_t set;
+	if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+		report << ", cpus";
+		for (int i=0; i<CPU_SETSIZE; i++) {
+			if (CPU_ISSET(i, &set)) {
+				report << " " << i;
+			}
+		}
 	}
+	if (policy_ != RealtimeConfig::DEADLINE) {
+		report << ", wake " << WakeTimer::mode_name(config_.wake_mode);
+	}
+	if (policy_ != config_.policy) {
+		report << ", requested " << policy_name(config_.policy);
+	}
+	report << errors.str();
+	report_ = report.str();
+}
+
+void RealtimeThread::run_deadline()
+{
+	//printf("realtime thread started period_ns = %d, [%ld]\n", period_ns_, gettid());
+	exit_ = std::promise<void>();
+	set_scheduling();
+	bool deadline = policy_ == RealtimeConfig::DEADLINE;
+	WakeTimer wake_timer(config_.wake_mode);
+	started_.set_value();
 
 	auto next_time = std::chrono::steady_clock::now();
 	start_time_ = next_time;
 	while (!done_) {
-		next_time += std::chrono::nanoseconds(period_ns_);
+		auto wake_target = next_time;
+		auto wake = std::chrono::steady_clock::now();
+		if (deadline) {
+			// the kernel's periods are not aligned to start_time_, so cycles
+			// are measured from the previous wake
+			next_time = wake + std::chrono::nanoseconds(period_ns_);
+		} else {
+			next_time += std::chrono::nanoseconds(period_ns_);
+		}
 
 		update();
+		run_tasks();
+		cycle_stats_.record(wake_target, wake, std::chrono::steady_clock::now(), next_time);
 
-		if(!deadline_permissions) {
-			std::this_thread::sleep_until(next_time);
+		if(!deadline) {
+			wake_timer.wait_until(next_time);
 		} else {
 			sched_yield();
 		}
@@ -135,3 +227,68 @@ void RealtimeThread::run_deadline()
 	exit_.set_value();
 	//printf("realtime thread finish [%ld]\n", gettid());
 }
+
+static uint32_t gcd(uint32_t a, uint32_t b) {
+	while (b) {
+		uint32_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+size_t RealtimeThread::add_task(std::string name, uint32_t divisor, std::function<void ()> fun, int phase) {
+	if (divisor == 0) {
+		throw std::runtime_error("Task " + name + " divisor must be at least 1");
+	}
+	if (phase >= static_cast<int>(divisor) || (phase < 0 && phase != kAutoPhase)) {
+		throw std::runtime_error("Task " + name + " phase must be less than its divisor");
+	}
+	if (phase == kAutoPhase) {
+		// Task j runs on the same cycle as phase p when p and its phase are
+		// congruent modulo gcd(divisor, divisor_j), which is then the case on
+		// gcd/divisor_j of the new task's runs. Pick the phase with the least.
+		double best = -1;
+		for (uint32_t p=0; p<divisor; p++) {
+			double shared = 0;
+			for (auto &t : tasks_) {
+				uint32_t g = gcd(divisor, t->divisor);
+				if (p % g == t->phase % g) {
+					shared += static_cast<double>(g)/t->divisor;
+				}
+			}
+			if (best < 0 || shared < best) {
+				best = shared;
+				phase = p;
+			}
+		}
+	}
+	tasks_.emplace_back(new ScheduledTask);
+	auto &task = *tasks_.back();
+	task.name = name;
+	task.divisor = divisor;
+	task.phase = phase;
+	task.fun = fun;
+	return tasks_.size() - 1;
+}
+
+std::vector<TaskStatsSnapshot> RealtimeThread::task_stats() const {
+	std::vector<TaskStatsSnapshot> stats;
+	for (auto &t : tasks_) {
+		stats.push_back({t->name, t->divisor, t->phase, t->runs.load(std::memory_order_relaxed), t->exec_time.snapshot()});
+	}
+	return stats;
+}
+
+void RealtimeThread::run_tasks() {
+	for (auto &t : tasks_) {
+		if (cycle_ % t->divisor == t->phase) {
+			auto start = std::chrono::steady_clock::now();
+			t->fun();
+			t->exec_time.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - start).count());
+			t->runs.store(t->runs.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+	}
+	cycle_++;
+}
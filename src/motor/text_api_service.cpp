@@ -0,0 +1,200 @@
+#include "text_api_service.h"
+#include "motor.h"
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+const size_t TextAPIRequest::kMaxLength;
+const size_t TextAPIReply::kMaxLength;
+
+static long futex(std::atomic<uint32_t> *word, int op, uint32_t val, const struct timespec *timeout) {
+    return syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), op, val, timeout, nullptr, 0);
+}
+
+TextAPIService::Channel::Channel(TextAPIService *service, size_t capacity) : service_(service) {
+    for (size_t i=0; i<service->size(); i++) {
+        requests_.emplace_back(capacity);
+        replies_.emplace_back(capacity);
+    }
+}
+
+bool TextAPIService::Channel::send(int motor, const char *request, uint32_t id) {
+    TextAPIRequest r;
+    size_t length = strnlen(request, TextAPIRequest::kMaxLength + 1);
+    if (length > TextAPIRequest::kMaxLength) {
+        return false;
+    }
+    r.id = id;
+    r.length = length;
+    std::memcpy(r.data, request, length);
+    if (!requests_[motor].push(r)) {
+        return false;
+    }
+    service_->notify(motor);
+    return true;
+}
+
+bool TextAPIService::Channel::receive(TextAPIReply *reply) {
+    for (size_t i=0; i<replies_.size(); i++) {
+        size_t motor = next_reply_;
+        next_reply_ = (next_reply_ + 1) % replies_.size();
+        if (replies_[motor].pop(reply, 1)) {
+            if (requests_[motor].size()) {
+                // a request may be waiting for the reply slot just freed
+                service_->notify(motor);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+TextAPIService::TextAPIService(const std::vector<std::shared_ptr<Motor>> &motors) {
+    for (auto &motor : motors) {
+        workers_.emplace_back(new Worker);
+        workers_.back()->motor = motor;
+    }
+    for (int i=0; i<workers_.size(); i++) {
+        workers_[i]->thread = std::thread([this, i]{ run(i); });
+    }
+}
+
+TextAPIService::~TextAPIService() {
+    done_ = true;
+    for (int i=0; i<workers_.size(); i++) {
+        notify(i);
+    }
+    for (auto &worker : workers_) {
+        worker->thread.join();
+    }
+}
+
+TextAPIService::Channel *TextAPIService::channel(size_t capacity) {
+    std::lock_guard<std::mutex> lock(channels_mutex_);
+    int n = num_channels_.load(std::memory_order_relaxed);
+    if (n == kMaxChannels) {
+        throw std::runtime_error("Too many text api channels, maximum is " + std::to_string(kMaxChannels));
+    }
+    channels_[n].reset(new Channel(this, capacity));
+    num_channels_.store(n + 1, std::memory_order_release);
+    return channels_[n].get();
+}
+
+std::future<std::string> TextAPIService::request(int motor, std::string request) {
+    auto promise = std::make_shared<std::promise<std::string>>();
+    auto future = promise->get_future();
+    this->request(motor, request, [promise](const TextAPIReply &reply) {
+        if (reply.ok) {
+            promise->set_value(reply.str());
+        } else {
+            promise->set_exception(std::make_exception_ptr(std::runtime_error(reply.str())));
+        }
+    });
+    return future;
+}
+
+void TextAPIService::request(int motor, std::string request, std::function<void(const TextAPIReply &)> callback) {
+    if (motor < 0 || motor >= workers_.size()) {
+        throw std::runtime_error("No motor " + std::to_string(motor) + " for text api request " + request);
+    }
+    if (request.size() > TextAPIRequest::kMaxLength) {
+        throw std::runtime_error("Text api request too long: " + request);
+    }
+    Worker &worker = *workers_[motor];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.pending.push_back({request, callback});
+    }
+    notify(motor);
+}
+
+void TextAPIService::notify(int motor) {
+    Worker &worker = *workers_[motor];
+    worker.requests.fetch_add(1, std::memory_order_release);
+    // pairs with the fence in run(), either this sees the worker sleeping or
+    // the worker sees the new request count
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (worker.sleeping.load(std::memory_order_relaxed)) {
+        futex(&worker.requests, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr);
+    }
+}
+
+TextAPIReply TextAPIService::transfer(int motor, const char *request, size_t length, uint32_t id) {
+    TextAPIReply reply = {};
+    reply.id = id;
+    reply.motor = motor;
+    std::string s;
+    try {
+        TextFile *text = workers_[motor]->motor->motor_text();
+        char c[TextAPIReply::kMaxLength];
+        auto nbytes = text->writeread(request, length, c, sizeof(c));
+        s.assign(c, nbytes > 0 ? nbytes : 0);
+        reply.ok = true;
+    } catch (std::exception &e) {
+        s = e.what();
+        reply.ok = false;
+    }
+    reply.length = std::min(s.size(), TextAPIReply::kMaxLength);
+    std::memcpy(reply.data, s.data(), reply.length);
+    completed_.fetch_add(1, std::memory_order_relaxed);
+    return reply;
+}
+
+void TextAPIService::run(int motor) {
+    Worker &worker = *workers_[motor];
+    while (!done_) {
+        uint32_t requests = worker.requests.load(std::memory_order_acquire);
+        bool busy = false;
+        // one request from each caller per round
+        int num_channels = num_channels_.load(std::memory_order_acquire);
+        for (int i=0; i<num_channels; i++) {
+            Channel &channel = *channels_[i];
+            TextAPIRequest request;
+            // only take a request when its reply has somewhere to go
+            if (channel.replies_[motor].size() < channel.replies_[motor].capacity() &&
+                    channel.requests_[motor].pop(&request, 1)) {
+                channel.replies_[motor].push(transfer(motor, request.data, request.length, request.id));
+                busy = true;
+            }
+        }
+        Pending pending;
+        bool have_pending = false;
+        {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            if (worker.pending.size()) {
+                pending = std::move(worker.pending.front());
+                worker.pending.pop_front();
+                have_pending = true;
+            }
+        }
+        if (have_pending) {
+            TextAPIReply reply = transfer(motor, pending.request.c_str(), pending.request.size(), 0);
+            if (pending.callback) {
+                // an exception must not end the worker thread
+                try {
+                    pending.callback(reply);
+                } catch (std::exception &e) {
+                    std::cerr << "Text api callback error, motor " << motor << ": " << e.what() << std::endl;
+                } catch (...) {
+                    std::cerr << "Text api callback error, motor " << motor << std::endl;
+                }
+            }
+            busy = true;
+        }
+        if (busy) {
+            continue;
+        }
+        worker.sleeping.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (worker.requests.load(std::memory_order_relaxed) == requests && !done_) {
+            // receive() notifies when it frees a reply slot a request waits on
+            struct timespec ts = {0, 100000000};
+            futex(&worker.requests, FUTEX_WAIT_PRIVATE, requests, &ts);
+        }
+        worker.sleeping.store(0, std::memory_order_relaxed);
+    }
+}
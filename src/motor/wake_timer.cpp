@@ -0,0 +1,114 @@
+#include "wake_timer.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/timerfd.h>
+
+static timespec to_timespec(std::chrono::steady_clock::time_point t) {
+    // steady_clock is CLOCK_MONOTONIC
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+    timespec ts;
+    ts.tv_sec = ns / 1000000000;
+    ts.tv_nsec = ns % 1000000000;
+    return ts;
+}
+
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+#endif
+}
+
+const int64_t WakeTimer::kMinMarginNs;
+const int64_t WakeTimer::kMaxMarginNs;
+
+WakeTimer::WakeTimer(Mode mode) : mode_(mode) {
+    if (mode_ == TIMERFD) {
+        fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if (fd_ < 0) {
+            throw std::runtime_error("timerfd_create error: " + std::string(std::strerror(errno)));
+        }
+    }
+}
+
+WakeTimer::~WakeTimer() {
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+std::string WakeTimer::mode_name(Mode mode) {
+    switch (mode) {
+        case SPIN: return "spin";
+        case HYBRID: return "hybrid";
+        case TIMERFD: return "timerfd";
+        default: return "sleep";
+    }
+}
+
+void WakeTimer::sleep_until(std::chrono::steady_clock::time_point t) {
+    timespec ts = to_timespec(t);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR);
+}
+
+void WakeTimer::spin_until(std::chrono::steady_clock::time_point t) {
+    while (std::chrono::steady_clock::now() < t) {
+        cpu_relax();
+    }
+}
+
+void WakeTimer::arm(std::chrono::steady_clock::time_point t) {
+    itimerspec its = {};
+    its.it_value = to_timespec(t);
+    if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) {
+        its.it_value.tv_nsec = 1; // zero would disarm
+    }
+    timerfd_settime(fd_, TFD_TIMER_ABSTIME, &its, nullptr);
+}
+
+void WakeTimer::wait_until(std::chrono::steady_clock::time_point t) {
+    if (!thread_setup_) {
+        // timer slack is per thread and adds up to 50 us to every sleep
+        prctl(PR_SET_TIMERSLACK, 1);
+        thread_setup_ = true;
+    }
+    switch (mode_) {
+        case SPIN:
+            spin_until(t);
+            break;
+        case HYBRID: {
+            auto wake_target = t - std::chrono::nanoseconds(margin_ns_);
+            if (wake_target > std::chrono::steady_clock::now()) {
+                sleep_until(wake_target);
+                int64_t error = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - wake_target).count();
+                if (error > margin_ns_) {
+                    margin_ns_ = error + error/4;
+                } else {
+                    margin_ns_ -= (margin_ns_ - error)/256;
+                }
+                margin_ns_ = std::max(kMinMarginNs, std::min(kMaxMarginNs, margin_ns_));
+            }
+            spin_until(t);
+            break;
+        }
+        case TIMERFD: {
+            if (t <= std::chrono::steady_clock::now()) {
+                break;
+            }
+            arm(t);
+            uint64_t expirations;
+            while (read(fd_, &expirations, sizeof(expirations)) < 0 && errno == EINTR);
+            break;
+        }
+        default:
+            sleep_until(t);
+            break;
+    }
+}
@@ -1,6 +1,7 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 #include <pybind11/operators.h>
+#include <sstream>
 #include "motor_manager.h"
 
 namespace py = pybind11;
@@ -23,16 +24,20 @@ PYBIND11_MODULE(motor, m) {
         .def("get_motors_by_devpath", &MotorManager::get_motors_by_devpath, py::arg("devpaths"), py::arg("connect") = true, py::arg("allow_simulated") = false)
         .def("motors", &MotorManager::motors)
         .def("set_motors", &MotorManager::set_motors)
-        .def("read", &MotorManager::read)
+        .def("read", static_cast<const std::vector<Status> &(MotorManager::*)()>(&MotorManager::read))
         .def("write", &MotorManager::write)
         .def("write_saved_commands", &MotorManager::write_saved_commands)
         .def("aread", &MotorManager::aread)
         .def("poll", &MotorManager::poll)
         .def("commands", &MotorManager::commands)
-        .def("set_commands", &MotorManager::set_commands)
+        .def("set_commands", static_cast<void (MotorManager::*)(const std::vector<Command> &)>(&MotorManager::set_commands))
+        .def("get_text", &MotorManager::get_text, py::arg("names"))
+        .def("snapshot_parameters", [](MotorManager &m, const std::vector<std::string> &names) { return m.snapshot_parameters(names); }, py::arg("names"))
+        .def("restore_parameters", &MotorManager::restore_parameters, py::arg("sets"), py::arg("verify") = true)
         .def("set_auto_count", &MotorManager::set_auto_count, py::arg("on") = true)
+        .def("set_io_uring", &MotorManager::set_io_uring, py::arg("io_uring") = true)
         .def("set_command_count", &MotorManager::set_command_count)
-        .def("set_command_mode", static_cast<void (MotorManager::*)(std::vector<uint8_t>)>(&MotorManager::set_command_mode))
+        .def("set_command_mode", static_cast<void (MotorManager::*)(const std::vector<uint8_t> &)>(&MotorManager::set_command_mode))
         .def("set_command_mode", static_cast<void (MotorManager::*)(uint8_t)>(&MotorManager::set_command_mode))
         .def("set_command_current", &MotorManager::set_command_current)
         .def("set_command_position", &MotorManager::set_command_position)
@@ -51,7 +56,8 @@ PYBIND11_MODULE(motor, m) {
         .def("__getitem__", &Motor::operator[])
         .def("__setitem__", [](Motor &m, const std::string key, const std::string value) {
             m[key].set(value);
-        });
+        })
+        .def("get", &Motor::get, py::arg("names"));
 
     py::class_<TextAPIItem>(m, "TextAPIItem")
         .def("__repr__", &TextAPIItem::get)
@@ -60,6 +66,29 @@ PYBIND11_MODULE(motor, m) {
         //.def("assign", static_cast<void (TextAPIItem::*)(const std::string &)>(&TextAPIItem::operator=));
         .def("assign", &TextAPIItem::set);
 
+    py::class_<TextAPIValue>(m, "TextAPIValue")
+        .def_readonly("name", &TextAPIValue::name)
+        .def_readonly("str", &TextAPIValue::str)
+        .def("is_number", &TextAPIValue::is_number)
+        .def("as_double", &TextAPIValue::as_double)
+        .def("as_int", &TextAPIValue::as_int)
+        .def("__repr__", [](const TextAPIValue &v) { return "<TextAPIValue " + v.name + ": " + v.str + ">"; });
+
+    py::class_<MotorParameterSet>(m, "MotorParameterSet")
+        .def(py::init<>())
+        .def_readwrite("name", &MotorParameterSet::name)
+        .def_readwrite("serial_number", &MotorParameterSet::serial_number)
+        .def_readwrite("version", &MotorParameterSet::version)
+        .def_readwrite("values", &MotorParameterSet::values);
+
+    py::class_<MotorParameterReport>(m, "MotorParameterReport")
+        .def_readonly("name", &MotorParameterReport::name)
+        .def_property_readonly("time", [](const MotorParameterReport &r) { return std::chrono::duration<double>(r.time).count(); })
+        .def_readonly("parameters", &MotorParameterReport::parameters)
+        .def_readonly("errors", &MotorParameterReport::errors)
+        .def("ok", &MotorParameterReport::ok)
+        .def("__repr__", [](const MotorParameterReport &r) { std::stringstream ss; ss << r; return ss.str(); });
+
     py::enum_<ModeDesired>(m, "ModeDesired")
         .value("Open", ModeDesired::OPEN)
         .value("Damped", ModeDesired::DAMPED)